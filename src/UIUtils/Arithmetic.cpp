@@ -25,7 +25,7 @@ bool Arithmetic::operator ==(const Arithmetic& a) const
 
 bool Arithmetic::isInteger() const
 {
-    return (type == Int);
+    return (type == Int) || (type == Rational);
 }
 
 std::vector<std::string> Arithmetic::names()
@@ -34,6 +34,7 @@ std::vector<std::string> Arithmetic::names()
     ns[Int]= "int";
     ns[Double] = "double";
     ns[Float] = "float";
+    ns[Rational] = "rational";
     return ns;
 }
 
@@ -15,11 +15,12 @@ class Arithmetic
 {
 public:
 
-    enum Type {Int, Double, Float, numTypes};
+    enum Type {Int, Double, Float, Rational, numTypes};
 
     Arithmetic(Type type = Type(0));
     Arithmetic(const std::string& s);
     bool operator ==(const Arithmetic& a) const;
+    // rational input is computed with integers after clearing denominators
     bool isInteger() const;
     static std::vector<std::string> names();
     friend std::ostream& operator <<(std::ostream& os, const Arithmetic& a);
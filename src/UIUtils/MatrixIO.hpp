@@ -2,7 +2,10 @@
 #define MATRIXIO_HPP
 
 
+#include "Rational.hpp"
+
 #include <iostream>
+#include <vector>
 
 
 namespace UIUtils
@@ -31,6 +34,39 @@ bool readMatrix(std::istream& inputStream, MatrixType& m)
 }
 
 
+/* Read matrix with elements given exactly as integers, fractions or decimals,
+each row is multiplied by positive common denominator to become integer. */
+template <typename MatrixType>
+bool readRationalMatrix(std::istream& inputStream, MatrixType& m)
+{
+    try
+    {
+        size_t nrows, ncols;
+        inputStream >> nrows;
+        inputStream >> ncols;
+        m.resize(nrows, ncols);
+        std::vector<Utils::Rational> row(ncols);
+        std::vector<Utils::Integer> integerRow(ncols);
+        typedef typename MatrixType::value_type T;
+        for (size_t i = 0; i < m.nrows(); i++)
+        {
+            for (size_t j = 0; j < m.ncols(); j++)
+                if (!(inputStream >> row[j]))
+                    throw std::ios_base::failure("not a rational number");
+            Utils::clearDenominators(&row[0], ncols, &integerRow[0]);
+            for (size_t j = 0; j < m.ncols(); j++)
+                m(i, j) = static_cast<T>(integerRow[j]);
+        }
+    }
+    catch (...)
+    {
+        std::cerr << "ERROR: couldn't read matrix. qskeleton terminated.\n";
+        return false;
+    }
+    return true;
+}
+
+
 template <typename MatrixType>
 void writeMatrix(std::ostream& outputStream, const MatrixType& m)
 {
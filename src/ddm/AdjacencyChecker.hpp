@@ -2,10 +2,18 @@
 #define QDDM_ADJACENCY_CHECKER_HPP
 
 
+#include "BitArray.hpp"
+#include "BitPatternTree.hpp"
+#include "GaussianElimination.hpp"
 #include "Matrix.hpp"
 #include "Parameters.hpp"
 #include "Ray.hpp"
 #include "Summary.hpp"
+using Utils::BitArray;
+using Utils::Matrix;
+
+#include <algorithm>
+#include <vector>
 
 
 namespace DDM
@@ -17,16 +25,23 @@ class AdjacencyChecker
 {
 public:
 
-    AdjacencyChecker(AdjacencyTest _adjacencyTest, bool _doPlusPlus, Summary * _summary):
-        adjacencyTest(_adjacencyTest), doPlusPlus(_doPlusPlus), summary(_summary)
+    AdjacencyChecker(AdjacencyTest _adjacencyTest, bool _doPlusPlus,
+        size_t _numThreads, Summary * _summary):
+        adjacencyTest(_adjacencyTest), doPlusPlus(_doPlusPlus),
+        numThreads(_numThreads), summary(_summary), inequalityMatrix(0),
+        intArith(false), zerotol(0)
     {}
 
     typedef Ray<T, Set> Ray;
     typedef typename Set::value_type Idx;
 
     void setRank(size_t value) { rank = value; }
+    void setInequalityMatrix(const Matrix<T>* value) { inequalityMatrix = value; }
+    void setArithmetic(bool _intArith, const T& _zerotol)
+    { intArith = _intArith; zerotol = _zerotol; }
 
-    void computeAdjacency(Vector<Ray*>& rays, const Vector<Idx>& notProcessedInequalities);
+    void computeAdjacency(Vector<Ray*>& rays, const BitPatternTree<T, Set>& rayTree,
+        const BitArray& notProcessedInequalities);
 
 private:
 
@@ -34,125 +49,250 @@ private:
     {
         Ray* ray;
         Set* cobasis;
-        AdjacencyCandidate(Ray* _ray = 0, Set* _cobasis = 0):
-            ray(_ray), cobasis(_cobasis) {}
+        size_t rayIdx; // index of ray in the list adjacency is computed for
+        AdjacencyCandidate(Ray* _ray = 0, Set* _cobasis = 0, size_t _rayIdx = 0):
+            ray(_ray), cobasis(_cobasis), rayIdx(_rayIdx) {}
     };
 
-    void findAdjacencyCandidates(size_t rayIdx,
-        const Vector<Ray*>& rays, Vector<AdjacencyCandidate>& candidates,
-        const Vector<Idx>& notProcessedInequalities);
+    void computeAdjacencyParallel(Vector<Ray*>& rays,
+        const BitPatternTree<T, Set>& rayTree);
 
-    void testAdjacency(size_t rayIdx,
-        const Vector<Ray*>& rays,
+    size_t findAdjacencyCandidates(size_t rayIdx,
+        const Vector<Ray*>& rays, const BitPatternTree<T, Set>& rayTree,
         Vector<AdjacencyCandidate>& candidates);
 
+    void markPositiveRays(const Vector<Ray*>& rays,
+        const BitArray& notProcessedInequalities);
+
+    size_t testAdjacency(const Ray* ray,
+        const Vector<Ray*>& rays, const Vector<Ray*>& extraNeighbours,
+        Vector<AdjacencyCandidate>& candidates, Vector<Ray*>& graphVertices);
+
+    void addEdges(Ray* ray, Vector<AdjacencyCandidate>& candidates);
+
     void combinatoricTest(const Ray* ray,
         const Vector<Ray*>& rays, Vector<AdjacencyCandidate>& candidates);
 
-    void graphTest(const Ray* ray,
-        Vector<AdjacencyCandidate>& candidates);
+    void algebraicTest(const Ray* ray, Vector<AdjacencyCandidate>& candidates);
+
+    void graphTest(const Ray* ray, const Vector<Ray*>& extraNeighbours,
+        Vector<AdjacencyCandidate>& candidates, Vector<Ray*>& graphVertices);
 
     void removeDominatedEdges(const Ray* ray,
         const Vector<Ray*>& rays, Vector<AdjacencyCandidate>& candidates);
 
+    void buildInequalityIndex(const Vector<Ray*>& rays);
+
+    void removeDominatedEdgesIndexed(const Ray* ray,
+        const Vector<Ray*>& rays, Vector<AdjacencyCandidate>& candidates);
+
     AdjacencyTest adjacencyTest;
     bool doPlusPlus;
+    size_t numThreads;
     Summary * summary;
     size_t rank;
+    const Matrix<T>* inequalityMatrix; // needed only for algebraic test
+    bool intArith;
+    T zerotol;
+    // Inverted index for combinatoric test: rays incident to i-th inequality
+    // are raysByInequality[raysByInequalityOffsets[i] .. [i + 1]).
+    std::vector<size_t> raysByInequality, raysByInequalityOffsets;
+    // For plusplus: whether i-th ray has positive discrepancies on all not
+    // processed inequalities, edges between such rays are not needed.
+    std::vector<char> positiveOnRemaining;
 
 };
 
 
 template <typename T, typename Set>
 void AdjacencyChecker<T, Set>::computeAdjacency(Vector<Ray*>& rays,
-    const Vector<Idx>& notProcessedInequalities)
+    const BitPatternTree<T, Set>& rayTree,
+    const BitArray& notProcessedInequalities)
 {
+    if (adjacencyTest == AdjacencyTest::Combinatoric)
+    {
+        summary->startAdjacencyTesting();
+        buildInequalityIndex(rays);
+        summary->endAdjacencyTesting();
+    }
+    if (doPlusPlus)
+    {
+        summary->startPotentialAdjacencyTesting();
+        markPositiveRays(rays, notProcessedInequalities);
+        summary->endPotentialAdjacencyTesting();
+    }
+#ifdef USE_OPENMP
+    if (numThreads > 1)
+    {
+        computeAdjacencyParallel(rays, rayTree);
+        return;
+    }
+#endif
     Vector<AdjacencyCandidate> candidates(rays.size());
+    Vector<Ray*> graphVertices(rays.size()), noExtraNeighbours;
     for (size_t i = 0; i < rays.size(); ++i)
     {
-        findAdjacencyCandidates(i, rays, candidates, notProcessedInequalities);
-        testAdjacency(i, rays, candidates);
-        for (size_t j = 0; j < candidates.size(); ++j)
+        summary->startPotentialAdjacencyTesting();
+        summary->addPotentialAdjacencyTests(findAdjacencyCandidates(i, rays,
+            rayTree, candidates));
+        summary->endPotentialAdjacencyTesting();
+        summary->startAdjacencyTesting();
+        summary->addAdjacencyTests(testAdjacency(rays[i], rays,
+            noExtraNeighbours, candidates, graphVertices));
+        summary->endAdjacencyTesting();
+        addEdges(rays[i], candidates);
+    }
+}
+
+
+/* Multithreaded version of computeAdjacency(), gives exactly the same
+adjacency lists. Candidates are found and tested for all rays in parallel, each
+thread using its own buffers, and then edges are added in the serial order.
+Edges found on the current call are not yet in adjacentRays during testing, so
+for the graph test each ray also uses all candidates with smaller indexes,
+which is a superset of the neighbours the serial version would see. */
+template <typename T, typename Set>
+void AdjacencyChecker<T, Set>::computeAdjacencyParallel(Vector<Ray*>& rays,
+    const BitPatternTree<T, Set>& rayTree)
+{
+    const long numRays = (long)rays.size();
+    std::vector<Vector<AdjacencyCandidate>*> candidates(numRays);
+    size_t numPotentialTests = 0;
+    summary->startPotentialAdjacencyTesting();
+    #pragma omp parallel num_threads((int)numThreads) \
+        reduction(+:numPotentialTests)
+    {
+        Vector<AdjacencyCandidate> threadCandidates(numRays);
+        #pragma omp for schedule(dynamic, 16)
+        for (long i = 0; i < numRays; ++i)
         {
-            rays[i]->adjacentRays.push_back(candidates[j].ray);
-            candidates[j].ray->adjacentRays.push_back(rays[i]);
-            delete candidates[j].cobasis;
+            numPotentialTests += findAdjacencyCandidates(i, rays, rayTree,
+                threadCandidates);
+            candidates[i] =
+                new Vector<AdjacencyCandidate>(threadCandidates.size());
+            for (size_t j = 0; j < threadCandidates.size(); ++j)
+                candidates[i]->push_back(threadCandidates[j]);
+            threadCandidates.clear();
         }
-        summary->addEdges(candidates.size());
-        candidates.clear();
+    }
+    summary->addPotentialAdjacencyTests(numPotentialTests);
+    summary->endPotentialAdjacencyTesting();
+
+    std::vector<Vector<Ray*>*> extraNeighbours(numRays);
+    std::vector<size_t> numExtraNeighbours(numRays, 0);
+    if (adjacencyTest == AdjacencyTest::Graph)
+        for (long i = 0; i < numRays; ++i)
+            for (size_t j = 0; j < candidates[i]->size(); ++j)
+                ++numExtraNeighbours[(*candidates[i])[j].rayIdx];
+    for (long i = 0; i < numRays; ++i)
+        extraNeighbours[i] = new Vector<Ray*>(numExtraNeighbours[i]);
+    if (adjacencyTest == AdjacencyTest::Graph)
+        for (long i = 0; i < numRays; ++i)
+            for (size_t j = 0; j < candidates[i]->size(); ++j)
+                extraNeighbours[(*candidates[i])[j].rayIdx]->push_back(rays[i]);
+
+    size_t numTests = 0;
+    summary->startAdjacencyTesting();
+    #pragma omp parallel num_threads((int)numThreads) reduction(+:numTests)
+    {
+        Vector<Ray*> threadGraphVertices(numRays);
+        #pragma omp for schedule(dynamic, 16)
+        for (long i = 0; i < numRays; ++i)
+            numTests += testAdjacency(rays[i], rays, *extraNeighbours[i],
+                *candidates[i], threadGraphVertices);
+    }
+    summary->addAdjacencyTests(numTests);
+    summary->endAdjacencyTesting();
+
+    for (long i = 0; i < numRays; ++i)
+    {
+        addEdges(rays[i], *candidates[i]);
+        delete candidates[i];
+        delete extraNeighbours[i];
     }
 }
 
 
+/* Add edges between ray and all candidates, clear candidates. */
 template <typename T, typename Set>
-void AdjacencyChecker<T, Set>::findAdjacencyCandidates(size_t rayIdx,
-    const Vector<Ray*>& rays, Vector<AdjacencyCandidate>& candidates,
-    const Vector<Idx>& notProcessedInequalities)
+void AdjacencyChecker<T, Set>::addEdges(Ray* ray,
+    Vector<AdjacencyCandidate>& candidates)
+{
+    for (size_t j = 0; j < candidates.size(); ++j)
+    {
+        ray->adjacentRays.push_back(candidates[j].ray);
+        candidates[j].ray->adjacentRays.push_back(ray);
+        delete candidates[j].cobasis;
+    }
+    summary->addEdges(candidates.size());
+    candidates.clear();
+}
+
+
+/* Find candidates for adjacency with given ray among rays with greater
+indexes using tree built for rays, return number of potential adjacency tests
+performed. */
+template <typename T, typename Set>
+size_t AdjacencyChecker<T, Set>::findAdjacencyCandidates(size_t rayIdx,
+    const Vector<Ray*>& rays, const BitPatternTree<T, Set>& rayTree,
+    Vector<AdjacencyCandidate>& candidates)
 {
     const Ray* ray = rays[rayIdx];
     // For simple rays the total number of adjacent rays is exactly rank + 1.
     // In this case check if all adjacent rays have already been found.
     if (!doPlusPlus && (ray->cobasis.size() == rank - 1) && (ray->adjacentRays.size() == rank + 1))
-        return;
+        return 0;
 
-    bool plusPlusApplicable = true;
-    if (doPlusPlus)
-    {
-        for (size_t i = 0; i < notProcessedInequalities.size(); ++i)
-            if (ray->discrepancies[notProcessedInequalities[i]] <= 0)
-            {
-                plusPlusApplicable = false;
-                break;
-            }
-    }
-    else
-        plusPlusApplicable = false;
+    const bool plusPlusApplicable = doPlusPlus && positiveOnRemaining[rayIdx];
 
-    summary->startPotentialAdjacencyTesting();
-    for (size_t i = rayIdx + 1; i < rays.size(); ++i)
+    // Criteria for adjacency candidates is whether size of common cobasis
+    // is at least rank - 2.
+    Vector<size_t> neighbours(rays.size() - rayIdx);
+    size_t numTests = rayTree.findIntersecting(rayIdx,
+        (rank > 2) ? rank - 2 : 0, neighbours);
+    for (size_t k = 0; k < neighbours.size(); ++k)
     {
-        // Criteria for adjacency candidates is whether size of common cobasis
-        // is at least rank - 2.
-        if (intersectionSize(ray->cobasis, rays[i]->cobasis) + 2 >= rank)
-        {
-            bool eliminateEdge = true;
-            if (plusPlusApplicable)
-            {
-                for (size_t j = 0; j < notProcessedInequalities.size(); ++j)
-                    if (rays[i]->discrepancies[notProcessedInequalities[j]] <= 0)
-                    {
-                        eliminateEdge = false;
-                        break;
-                    }
-            }
-            else
-                eliminateEdge = false;
-            if (!eliminateEdge)
-                candidates.push_back(AdjacencyCandidate(rays[i],
-                    new Set(ray->cobasis, rays[i]->cobasis)));
-        }
+        const size_t i = neighbours[k];
+        if (!plusPlusApplicable || !positiveOnRemaining[i])
+            candidates.push_back(AdjacencyCandidate(rays[i],
+                new Set(ray->cobasis, rays[i]->cobasis), i));
     }
-    summary->addPotentialAdjacencyTests(rays.size() - rayIdx - 1);
-    summary->endPotentialAdjacencyTesting();
+    return numTests;
 }
 
 
+/* For each ray check with word operations on sign bits whether all its
+discrepancies on not processed inequalities are positive. */
 template <typename T, typename Set>
-void AdjacencyChecker<T, Set>::testAdjacency(size_t rayIdx,
-    const Vector<Ray*>& rays, Vector<AdjacencyCandidate>& candidates)
+void AdjacencyChecker<T, Set>::markPositiveRays(const Vector<Ray*>& rays,
+    const BitArray& notProcessedInequalities)
+{
+    positiveOnRemaining.resize(rays.size());
+    for (size_t i = 0; i < rays.size(); ++i)
+        positiveOnRemaining[i] =
+            !notProcessedInequalities.intersects(rays[i]->nonPositiveBits);
+}
+
+
+/* Remove candidates not adjacent to ray, return number of adjacency tests
+performed. */
+template <typename T, typename Set>
+size_t AdjacencyChecker<T, Set>::testAdjacency(const Ray* ray,
+    const Vector<Ray*>& rays, const Vector<Ray*>& extraNeighbours,
+    Vector<AdjacencyCandidate>& candidates, Vector<Ray*>& graphVertices)
 {
     // For simple rays each candidate is adjacent, no need to check;
     // same if rank <= 3 for all rays.
-    Ray* ray = rays[rayIdx];
     if ((ray->cobasis.size() == rank - 1) || (rank <= 3))
-        return;
-    summary->startAdjacencyTesting();
-    summary->addAdjacencyTests(candidates.size());
+        return 0;
+    size_t numTests = candidates.size();
     if (adjacencyTest == AdjacencyTest::Graph)
-        graphTest(ray, candidates);
+        graphTest(ray, extraNeighbours, candidates, graphVertices);
     else if (adjacencyTest == AdjacencyTest::Combinatoric)
         combinatoricTest(ray, rays, candidates);
-    summary->endAdjacencyTesting();
+    else if (adjacencyTest == AdjacencyTest::Algebraic)
+        algebraicTest(ray, candidates);
+    return numTests;
 }
 
 
@@ -160,20 +300,104 @@ template <typename T, typename Set>
 void AdjacencyChecker<T, Set>::combinatoricTest(const Ray* ray,
     const Vector<Ray*>& rays, Vector<AdjacencyCandidate>& candidates)
 {
-    removeDominatedEdges(ray, rays, candidates);
+    removeDominatedEdgesIndexed(ray, rays, candidates);
 }
 
 
+/* Candidate is adjacent iff rank of inequalities of common cobasis C is
+rank - 2. Inequalities of ray cobasis Z are eliminated once per ray: a basis B
+of them is found and the others are expressed via B. Then rank of C is
+|C & B| plus rank of the small residual matrix of coefficients for rows B \ C
+and columns C \ B, so no elimination on full rows is needed per candidate. */
 template <typename T, typename Set>
-void AdjacencyChecker<T, Set>::graphTest(const Ray* ray,
+void AdjacencyChecker<T, Set>::algebraicTest(const Ray* ray,
     Vector<AdjacencyCandidate>& candidates)
 {
-    static Vector<Ray*> graphVertices(candidates.size() + ray->adjacentRays.size());
+    if (candidates.size() == 0)
+        return;
+    Vector<size_t> zeroSet = ray->cobasis.toVector();
+    const size_t numZero = zeroSet.size();
+    const size_t dim = inequalityMatrix->ncols();
+    Matrix<T> a(numZero, dim);
+    for (size_t i = 0; i < numZero; ++i)
+        for (size_t j = 0; j < dim; ++j)
+            a(i, j) = (*inequalityMatrix)(zeroSet[i], j);
+    Matrix<T> f, bas;
+    size_t zeroRank;
+    std::vector<size_t> perm;
+    gauss(a, numZero, f, bas, zeroRank, perm, intArith, zerotol);
+
+    // coefs(b, i) is (up to row scaling) coefficient of basis inequality b
+    // in expansion of i-th inequality of zeroSet.
+    Matrix<T> coefs(zeroRank, numZero);
+    std::vector<size_t> basisPos(numZero, zeroRank);
+    for (size_t b = 0; b < zeroRank; ++b)
+    {
+        basisPos[perm[b]] = b;
+        for (size_t i = 0; i < numZero; ++i)
+        {
+            T sum = 0;
+            for (size_t j = 0; j < dim; ++j)
+                sum += f(b, j) * a(i, j);
+            coefs(b, i) = sum;
+        }
+    }
+
+    std::vector<char> basisInCommon(zeroRank);
+    std::vector<size_t> residualCols(numZero);
+    std::vector<T> residual(zeroRank * numZero);
+    for (size_t c = 0; c < candidates.size();)
+    {
+        Vector<size_t> common = candidates[c].cobasis->toVector();
+        std::fill(basisInCommon.begin(), basisInCommon.end(), 0);
+        size_t numResidualCols = 0, commonRank = 0;
+        for (size_t i = 0, k = 0; k < common.size(); ++i)
+            if (zeroSet[i] == common[k])
+            {
+                ++k;
+                if (basisPos[i] < zeroRank)
+                {
+                    basisInCommon[basisPos[i]] = 1;
+                    ++commonRank;
+                }
+                else
+                    residualCols[numResidualCols++] = i;
+            }
+        size_t numResidualRows = 0;
+        for (size_t b = 0; b < zeroRank; ++b)
+            if (!basisInCommon[b])
+            {
+                for (size_t j = 0; j < numResidualCols; ++j)
+                    residual[numResidualRows * numResidualCols + j] =
+                        coefs(b, residualCols[j]);
+                ++numResidualRows;
+            }
+        if (numResidualCols)
+            commonRank += matrixRank(&residual[0], numResidualRows,
+                numResidualCols, intArith, zerotol);
+        if (commonRank + 2 == rank)
+            ++c;
+        else
+        {
+            delete candidates[c].cobasis;
+            candidates.erase(c);
+        }
+    }
+}
+
+
+template <typename T, typename Set>
+void AdjacencyChecker<T, Set>::graphTest(const Ray* ray,
+    const Vector<Ray*>& extraNeighbours, Vector<AdjacencyCandidate>& candidates,
+    Vector<Ray*>& graphVertices)
+{
     graphVertices.clear();
     for (size_t i = 0; i < candidates.size(); ++i)
         graphVertices.push_back(candidates[i].ray);
     for (size_t i = 0; i < ray->adjacentRays.size(); ++i)
         graphVertices.push_back(ray->adjacentRays[i]);
+    for (size_t i = 0; i < extraNeighbours.size(); ++i)
+        graphVertices.push_back(extraNeighbours[i]);
     removeDominatedEdges(ray, graphVertices, candidates);
 }
 
@@ -204,6 +428,80 @@ void AdjacencyChecker<T, Set>::removeDominatedEdges(const Ray* ray,
 }
 
 
+/* Build inverted index of rays by incident inequalities, it is shared by all
+candidates tested with removeDominatedEdgesIndexed() for these rays. */
+template <typename T, typename Set>
+void AdjacencyChecker<T, Set>::buildInequalityIndex(const Vector<Ray*>& rays)
+{
+    size_t numInequalities = inequalityMatrix->nrows();
+    raysByInequalityOffsets.assign(numInequalities + 1, 0);
+    for (size_t i = 0; i < rays.size(); ++i)
+    {
+        Vector<size_t> cobasis = rays[i]->cobasis.toVector();
+        for (size_t j = 0; j < cobasis.size(); ++j)
+            ++raysByInequalityOffsets[cobasis[j] + 1];
+    }
+    for (size_t i = 0; i < numInequalities; ++i)
+        raysByInequalityOffsets[i + 1] += raysByInequalityOffsets[i];
+    raysByInequality.resize(raysByInequalityOffsets[numInequalities]);
+    std::vector<size_t> position(raysByInequalityOffsets.begin(),
+        raysByInequalityOffsets.end() - 1);
+    for (size_t i = 0; i < rays.size(); ++i)
+    {
+        Vector<size_t> cobasis = rays[i]->cobasis.toVector();
+        for (size_t j = 0; j < cobasis.size(); ++j)
+            raysByInequality[position[cobasis[j]]++] = i;
+    }
+}
+
+
+/* Same as removeDominatedEdges() for all rays indexed by
+buildInequalityIndex(): only rays incident to the least frequent inequality
+of the edge cobasis are checked. */
+template <typename T, typename Set>
+void AdjacencyChecker<T, Set>::removeDominatedEdgesIndexed(const Ray* ray,
+    const Vector<Ray*>& rays, Vector<AdjacencyCandidate>& candidates)
+{
+    for (size_t i = 0; i < candidates.size();)
+    {
+        bool isDominated = false;
+        Ray* candidate = candidates[i].ray;
+        Set* edgeCobasis = candidates[i].cobasis;
+        Vector<size_t> edgeInequalities = edgeCobasis->toVector();
+        // edge cobasis is not empty as the test is only done for rank > 3
+        size_t rarestBegin = raysByInequalityOffsets[edgeInequalities[0]];
+        size_t rarestEnd = raysByInequalityOffsets[edgeInequalities[0] + 1];
+        for (size_t k = 1; k < edgeInequalities.size(); ++k)
+        {
+            size_t begin = raysByInequalityOffsets[edgeInequalities[k]];
+            size_t end = raysByInequalityOffsets[edgeInequalities[k] + 1];
+            if (end - begin < rarestEnd - rarestBegin)
+            {
+                rarestBegin = begin;
+                rarestEnd = end;
+            }
+        }
+        for (size_t k = rarestBegin; k < rarestEnd; ++k)
+        {
+            Ray* other = rays[raysByInequality[k]];
+            if ((other != ray) && (other != candidate) &&
+                edgeCobasis->isSubsetOf(other->cobasis))
+            {
+                isDominated = true;
+                break;
+            }
+        }
+        if (isDominated)
+        {
+            candidates.erase(i);
+            delete edgeCobasis;
+        }
+        else
+            ++i;
+    }
+}
+
+
 } // namespace DDM
 
 
@@ -3,15 +3,23 @@
 
 
 #include "AdjacencyChecker.hpp"
+#include "BinaryIO.hpp"
+#include "BitPatternTree.hpp"
 #include "GaussianElimination.hpp"
 #include "Matrix.hpp"
 #include "Parameters.hpp"
 #include "Pivoting.hpp"
+#include "Presolve.hpp"
 #include "Ray.hpp"
 #include "Set.hpp"
 #include "Summary.hpp"
 using namespace Utils;
 
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
 #include <vector>
 
 
@@ -23,8 +31,10 @@ template<typename T, typename Set>
 class Algorithm;
 
 
+/* Run algorithm choosing set type by number of inequalities, return false
+if it could not resume from a checkpoint. */
 template<typename T>
-void ddm(const Matrix<T>& rays,
+bool ddm(const Matrix<T>& rays,
     Parameters& params,
     bool intArith,
     const T &zerotol,
@@ -36,26 +46,48 @@ void ddm(const Matrix<T>& rays,
         if (rays.nrows() <= 32)
         {
             Algorithm<T, BitFieldSet<32> > alg(params);
-            alg.run(rays, intArith, zerotol, ine, ext);
-            return;
+            return alg.run(rays, intArith, zerotol, ine, ext);
         }
         if (rays.nrows() <= 64)
         {
             Algorithm<T, BitFieldSet<64> > alg(params);
-            alg.run(rays, intArith, zerotol, ine, ext);
-            return;
+            return alg.run(rays, intArith, zerotol, ine, ext);
         }
         if (rays.nrows() <= 96)
         {
             Algorithm<T, BitFieldSet<96> > alg(params);
-            alg.run(rays, intArith, zerotol, ine, ext);
-            return;
+            return alg.run(rays, intArith, zerotol, ine, ext);
         }
         if (rays.nrows() <= 128)
         {
             Algorithm<T, BitFieldSet<128> > alg(params);
-            alg.run(rays, intArith, zerotol, ine, ext);
-            return;
+            return alg.run(rays, intArith, zerotol, ine, ext);
+        }
+        // For larger inputs sizes grow twice to limit number of instances.
+        if (rays.nrows() <= 256)
+        {
+            Algorithm<T, BitFieldSet<256> > alg(params);
+            return alg.run(rays, intArith, zerotol, ine, ext);
+        }
+        if (rays.nrows() <= 512)
+        {
+            Algorithm<T, BitFieldSet<512> > alg(params);
+            return alg.run(rays, intArith, zerotol, ine, ext);
+        }
+        if (rays.nrows() <= 1024)
+        {
+            Algorithm<T, BitFieldSet<1024> > alg(params);
+            return alg.run(rays, intArith, zerotol, ine, ext);
+        }
+        if (rays.nrows() <= 2048)
+        {
+            Algorithm<T, BitFieldSet<2048> > alg(params);
+            return alg.run(rays, intArith, zerotol, ine, ext);
+        }
+        if (rays.nrows() <= 4096)
+        {
+            Algorithm<T, BitFieldSet<4096> > alg(params);
+            return alg.run(rays, intArith, zerotol, ine, ext);
         }
 
         // If impossible to find appropriate bitfield, use vector-based sets.
@@ -66,24 +98,21 @@ void ddm(const Matrix<T>& rays,
     if (rays.nrows() <= (1ULL << (8 * sizeof(unsigned char))))
     {
         Algorithm<T, VectorSet<unsigned char> > alg(params);
-        alg.run(rays, intArith, zerotol, ine, ext);
-        return;
+        return alg.run(rays, intArith, zerotol, ine, ext);
     }
     if (rays.nrows() <= (1ULL << (8 * sizeof(unsigned short))))
     {
         Algorithm< T, VectorSet<unsigned short> > alg(params);
-        alg.run( rays, intArith, zerotol, ine, ext);
-        return;
+        return alg.run(rays, intArith, zerotol, ine, ext);
     }
     if (rays.nrows() <= (1ULL << (8 * sizeof(unsigned int))))
     {
         Algorithm<T, VectorSet<unsigned int> > alg(params);
-        alg.run(rays, intArith, zerotol, ine, ext);
-        return;
+        return alg.run(rays, intArith, zerotol, ine, ext);
     }
     // If nothing else fits, use unsigned long.
     Algorithm<T, VectorSet<unsigned long> > alg(params);
-    alg.run(rays, intArith, zerotol, ine, ext);
+    return alg.run(rays, intArith, zerotol, ine, ext);
 }
 
 
@@ -96,7 +125,7 @@ public:
     Algorithm(Parameters& params);
     ~Algorithm();
 
-    void run(const Matrix<T>& rays,
+    bool run(const Matrix<T>& rays,
              bool intArith,
              const T zerotol,
              Matrix< T >& ine,
@@ -111,22 +140,45 @@ private:
     Parameters& m_params;
     bool m_intArith;
     T m_zerotol;
+    const Matrix<T>* m_input;
 
     Matrix<T> inequalityMatrix;
+    std::vector<size_t> inequalityIndexes; // rows of inequalityMatrix in input
     Matrix< T > m_bas;
     size_t m_rank;
+    // If dimension is reduced, rays are kept in coordinates of basis of rows
+    // of m_lift, otherwise it is empty.
+    Matrix<T> m_lift;
 
     Vector<Ray*> extremeRays;
+    BitPatternTree<T, Set> rayTree; // index over cobases of current zero rays
 
     Summary summary;
     AdjacencyChecker<T, Set> adjacencyChecker;
     Pivoting<T, Set> pivoting;
     RayFactory<T, Set>* rayFactory;
 
-    void makeInitialStep();
+    // iteration and time of last checkpoint
+    size_t lastCheckpointStep;
+    time_t lastCheckpointTime;
+
+    void createRayFactory();
+    void computeBasis(Matrix<T>& f, std::vector<size_t>& perm);
+    void reduceDimension(Matrix<T>& f);
+    void makeInitialStep(const Matrix<T>& f, const std::vector<size_t>& perm);
+    void liftRay(const Ray* ray, T* coords) const;
+    void computeAdjacency(Vector<Ray*>& rays);
     void finalize(Matrix<T>& a, std::vector< size_t >& ext );
+    void writeRays(std::ostream& os) const;
+    void writeRow(std::ostream& os, const T* row) const;
     void writeLog() const;
 
+    bool isCheckpointDue() const;
+    std::string checkpointSignature() const;
+    void writeCheckpoint();
+    bool readCheckpointHeader(std::istream& is);
+    bool readCheckpoint(std::istream& is);
+
     // copy and assignment are forbidden, no implementation:
     Algorithm( const Algorithm& );
     Algorithm& operator =( const Algorithm& );
@@ -138,9 +190,13 @@ private:
 template< typename T, typename Set >
 Algorithm< T, Set >::Algorithm( Parameters& params ):
     m_params( params ),
-    adjacencyChecker(params.adjacencyTest, params.usePlusPlus, &summary),
-    pivoting(params.pivotingOrder, params.usePlusPlus, &summary),
-    rayFactory(0)
+    adjacencyChecker(params.adjacencyTest, params.usePlusPlus, params.numThreads,
+        &summary),
+    pivoting(params.pivotingOrder, params.usePlusPlus,
+        params.furthestAssignment, params.numThreads, &summary),
+    rayFactory(0),
+    lastCheckpointStep(0),
+    lastCheckpointTime(0)
 {}
 
 
@@ -148,63 +204,153 @@ Algorithm< T, Set >::Algorithm( Parameters& params ):
 template< typename T, typename Set >
 Algorithm< T, Set >::~Algorithm()
 {
-    for (size_t i = 0; i < extremeRays.size(); ++i)
-        rayFactory->deleteRay(extremeRays[i]);
+    if (rayFactory)
+        for (size_t i = 0; i < extremeRays.size(); ++i)
+            rayFactory->deleteRay(extremeRays[i]);
     delete rayFactory;
 }
 
 
-/* Run algorithm with given input and additional params. */
+/* Run algorithm with given input and additional params, return false if it
+could not resume from a checkpoint. */
 template< typename T, typename Set >
-void Algorithm< T, Set >::run(const Matrix<T>& ines, bool intArith,
+bool Algorithm< T, Set >::run(const Matrix<T>& ines, bool intArith,
     const T zerotol, Matrix< T >& rays, std::vector< size_t >& ext )
 {
     // copy input data and params
     m_intArith = intArith;
     m_zerotol = zerotol;
+    m_input = &ines;
 
     summary.startComputations();
 
-    // rearrange inequalities if necessary
+    // presolve and rearrange inequalities if necessary and find basis, on
+    // resume take them as they were
     inequalityMatrix = ines;
-    pivoting.reorderInequalities(inequalityMatrix);
+    Matrix<T> f;
+    std::vector<size_t> perm;
+    std::ifstream checkpoint;
+    if (m_params.resume)
+    {
+        checkpoint.open(m_params.checkpointFile.c_str(), std::ios::binary);
+        if (!readCheckpointHeader(checkpoint))
+        {
+            std::cerr << "ERROR: couldn't resume from checkpoint "
+                << m_params.checkpointFile << ". qskeleton terminated.\n";
+            return false;
+        }
+    }
+    else
+    {
+        inequalityIndexes.resize(ines.nrows());
+        for (size_t i = 0; i < ines.nrows(); ++i)
+            inequalityIndexes[i] = i;
+        if (m_params.presolve)
+            summary.setNumRemovedInequalities(presolveInequalities(
+                inequalityMatrix, inequalityIndexes, intArith, zerotol));
+        pivoting.reorderInequalities(inequalityMatrix, inequalityIndexes);
+        computeBasis(f, perm);
+    }
     pivoting.setZerotol(zerotol);
     pivoting.setInequalityMatrix(&inequalityMatrix);
-
-    // initial step of the algorithm
-    makeInitialStep();
+    if (m_params.exactSigns && !intArith)
+        pivoting.enableSignFilter();
+    else if (m_params.discrepancyCacheMegabytes && !m_params.usePlusPlus)
+        pivoting.enableDiscrepancyCache(m_params.discrepancyCacheMegabytes << 20);
+    adjacencyChecker.setInequalityMatrix(&inequalityMatrix);
+    adjacencyChecker.setArithmetic(intArith, zerotol);
+
+    // initial step of the algorithm or state of interrupted computations
+    if (m_params.resume)
+    {
+        if (!readCheckpoint(checkpoint))
+        {
+            std::cerr << "ERROR: couldn't resume from checkpoint "
+                << m_params.checkpointFile << ". qskeleton terminated.\n";
+            return false;
+        }
+        *m_params.logStream << "Resumed from checkpoint "
+            << m_params.checkpointFile << ".\n";
+    }
+    else
+        makeInitialStep(f, perm);
     writeLog();
+    lastCheckpointStep = pivoting.getStep();
+    lastCheckpointTime = time(0);
 
     // main loop of the algorithm
     while (!pivoting.isEnded())
     {
         Vector<Ray*> zeroRays;
         pivoting.classifyRays(extremeRays, zeroRays);
-        adjacencyChecker.computeAdjacency(zeroRays, pivoting.notProcessedInequalities);
+        computeAdjacency(zeroRays);
         writeLog();
+        if (isCheckpointDue())
+            writeCheckpoint();
     }
     
     summary.endComputations();
     finalize( rays, ext );
+    return true;
 }
 
 
-/* Perform initial iteration: make simplex of non-degenerate (rank + 1) rays,
-assign rays to created facets. */
+/* Create ray factory after rank is known, spill it if necessary. */
 template< typename T, typename Set >
-void Algorithm< T, Set >::makeInitialStep()
+void Algorithm< T, Set >::createRayFactory()
 {
-    // perform gaussian elimination, find base and rank
-    summary.startComputingBasis();
-    Matrix<T> f;
-    std::vector<size_t> perm;
-    gauss( inequalityMatrix, inequalityMatrix.nrows(), f, m_bas, m_rank, perm, m_intArith, m_zerotol );
-    summary.endComputingBasis();
-
     rayFactory = new RayFactory<T, Set>(inequalityMatrix.ncols(), m_intArith,
         m_params.usePlusPlus ? inequalityMatrix.nrows() : 0);
+    if (!m_params.spillDirectory.empty() &&
+        !rayFactory->spillTo(m_params.spillDirectory))
+        std::cerr << "WARNING: couldn't create spill file in "
+            << m_params.spillDirectory << ", rays are kept in memory.\n";
     pivoting.setRayFactory(rayFactory);
     adjacencyChecker.setRank(m_rank);
+}
+
+
+/* Perform gaussian elimination, find basis, rank and rows f of initial
+simplex rays, reduce dimension to rank if possible. */
+template< typename T, typename Set >
+void Algorithm< T, Set >::computeBasis(Matrix<T>& f, std::vector<size_t>& perm)
+{
+    summary.startComputingBasis();
+    gauss( inequalityMatrix, inequalityMatrix.nrows(), f, m_bas, m_rank, perm, m_intArith, m_zerotol );
+    // Exact signs are certified for the input inequalities, rounded projected
+    // ones would not do.
+    if ((m_rank < inequalityMatrix.ncols()) &&
+        !(m_params.exactSigns && !m_intArith))
+        reduceDimension(f);
+    summary.endComputingBasis();
+}
+
+
+/* Rays are in the span of rows of f, so they are kept in coordinates of this
+basis and inequalities are projected to it: row a becomes a * transpose(f).
+Initial rays become unit vectors, rays are lifted back for output. */
+template< typename T, typename Set >
+void Algorithm< T, Set >::reduceDimension(Matrix<T>& f)
+{
+    if (!m_intArith)
+        for (size_t i = 0; i < f.nrows(); ++i)
+            normalizeFPVector(f.row(i), f.ncols());
+    inequalityMatrix = mmult(inequalityMatrix, transpose(f));
+    if (m_intArith)
+        for (size_t i = 0; i < inequalityMatrix.nrows(); ++i)
+            normalizeIntVector(inequalityMatrix.row(i), m_rank);
+    m_lift = std::move(f);
+    f.assign_eye(m_rank);
+}
+
+
+/* Perform initial iteration: make simplex of non-degenerate (rank + 1) rays
+from rows of f, assign rays to created facets. */
+template< typename T, typename Set >
+void Algorithm< T, Set >::makeInitialStep(const Matrix<T>& f,
+    const std::vector<size_t>& perm)
+{
+    createRayFactory();
     // now m_rank rows of f are inequalities (f[i], ray) >= 0 corresponding
     // to simplex facets, vertices of i-th facet are perm[j], j <> i;
     // create rays
@@ -230,7 +376,7 @@ void Algorithm< T, Set >::makeInitialStep()
 
     // find adjacency information for facets; it is simplex so each facet is
     // adjacent to all others but use common routine for updating adjacency
-    adjacencyChecker.computeAdjacency(extremeRays, pivoting.notProcessedInequalities);
+    computeAdjacency(extremeRays);
 
     // assign all rays to created facets outside sets
     summary.startPartitioning();
@@ -241,38 +387,56 @@ void Algorithm< T, Set >::makeInitialStep()
 }
 
 
+/* Compute adjacency for given rays, cobasis tree is built once for them. */
+template< typename T, typename Set >
+void Algorithm< T, Set >::computeAdjacency(Vector<Ray*>& rays)
+{
+    summary.startPotentialAdjacencyTesting();
+    rayTree.build(rays, inequalityMatrix.nrows());
+    summary.endPotentialAdjacencyTesting();
+    adjacencyChecker.computeAdjacency(rays, rayTree,
+        pivoting.notProcessedInequalities);
+    rayTree.clear();
+}
+
+
+/* Collect result: rays to matrix or, if output stream is given, directly to
+it, and indexes of facets. */
 template< typename T, typename Set >
 void Algorithm< T, Set >::finalize(Matrix<T>& rayMatrix,
     std::vector<size_t>& facets)
 {
-    rayMatrix.resize(0, inequalityMatrix.ncols());
-    // Write basis equalities as pairs of inequalities.
-    for (size_t i = 0; i < m_bas.nrows(); ++i)
+    const size_t dim = m_input->ncols();
+    const size_t numRays = 2 * m_bas.nrows() + extremeRays.size();
+    if (!m_params.outputStream)
     {
-        rayMatrix.insert_row(rayMatrix.nrows(), m_bas.row(i));
-        rayMatrix.insert_row(rayMatrix.nrows(), m_bas.row(i));
-        rayMatrix.mult_row(rayMatrix.nrows() - 1, -1);
+        rayMatrix.resize(numRays, dim);
+        // Write basis equalities as pairs of inequalities.
+        for (size_t i = 0; i < m_bas.nrows(); ++i)
+            for (size_t j = 0; j < dim; ++j)
+            {
+                rayMatrix(2 * i, j) = m_bas(i, j);
+                rayMatrix(2 * i + 1, j) = -m_bas(i, j);
+            }
+        // Write extreme rays inequalities.
+        for (size_t i = 0; i < extremeRays.size(); ++i)
+            liftRay(extremeRays[i], rayMatrix.row(2 * m_bas.nrows() + i));
     }
-    // Write extreme rays inequalities.
-    for (size_t i = 0; i < extremeRays.size(); ++i)
-        rayMatrix.insert_row(rayMatrix.nrows(), extremeRays[i]->coordinates);
-    summary.setNumExtremeRays(rayMatrix.nrows());
+    summary.setNumExtremeRays(numRays);
 
-    // Write indexes of facets.
+    // Write input indexes of facets in order of appearance.
+    std::vector<bool> isFacet(m_input->nrows(), false);
     for (size_t i = 0; i < extremeRays.size(); ++i)
     {
         Vector<size_t> rayInc = extremeRays[i]->cobasis.toVector();
         for (size_t k = 0; k < rayInc.size(); ++k)
         {
-            bool found = false;
-            for (size_t j = 0; j < facets.size(); ++j)
-                if (rayInc[k] == facets[j])
-                {
-                    found = true;
-                    break;
-                }
-            if (!found)
-                facets.push_back(rayInc[k]);
+            const size_t facet = inequalityIndexes[rayInc[k]];
+            if (!isFacet[facet])
+            {
+                isFacet[facet] = true;
+                facets.push_back(facet);
+            }
         }
     }
     summary.setNumFacets(facets.size());
@@ -296,6 +460,75 @@ void Algorithm< T, Set >::finalize(Matrix<T>& rayMatrix,
 
     summary.setNumIterations(pivoting.getStep());
     *m_params.summaryStream << "\n" << summary;
+
+    if (m_params.outputStream)
+        writeRays(*m_params.outputStream);
+}
+
+
+/* Coordinates of ray in the input space. */
+template< typename T, typename Set >
+void Algorithm< T, Set >::liftRay(const Ray* ray, T* coords) const
+{
+    const size_t dim = m_input->ncols();
+    if (!m_lift.nrows())
+    {
+        std::copy(ray->coordinates, ray->coordinates + dim, coords);
+        return;
+    }
+    std::fill(coords, coords + dim, (T)0);
+    for (size_t k = 0; k < m_lift.nrows(); ++k)
+        if (ray->coordinates[k] != 0)
+            for (size_t j = 0; j < dim; ++j)
+                coords[j] += ray->coordinates[k] * m_lift(k, j);
+    if (m_intArith)
+        normalizeIntVector(coords, dim);
+    else
+        normalizeFPVector(coords, dim);
+}
+
+
+/* Write basis equalities as pairs of opposite rays and extreme rays in the
+input format. Rows are formatted to a buffer which is written by large
+chunks. */
+template< typename T, typename Set >
+void Algorithm< T, Set >::writeRays(std::ostream& os) const
+{
+    const size_t dim = m_input->ncols();
+    os << 2 * m_bas.nrows() + extremeRays.size() << " " << dim << "\n";
+    std::ostringstream buffer;
+    buffer.copyfmt(os);
+    std::vector<T> negated(dim), coords(dim);
+    for (size_t i = 0; i < m_bas.nrows(); ++i)
+    {
+        for (size_t j = 0; j < dim; ++j)
+            negated[j] = -m_bas(i, j);
+        writeRow(buffer, m_bas.row(i));
+        writeRow(buffer, &negated[0]);
+    }
+    for (size_t i = 0; i < extremeRays.size(); ++i)
+    {
+        liftRay(extremeRays[i], &coords[0]);
+        writeRow(buffer, &coords[0]);
+        if (buffer.tellp() >= (std::streamoff)(1 << 20))
+        {
+            os << buffer.str();
+            buffer.str("");
+        }
+    }
+    os << buffer.str();
+    if (!os)
+        std::cerr << "ERROR: couldn't print matrix to output file.\n";
+}
+
+
+template< typename T, typename Set >
+void Algorithm< T, Set >::writeRow(std::ostream& os, const T* row) const
+{
+    const size_t dim = m_input->ncols();
+    for (size_t j = 0; j + 1 < dim; ++j)
+        os << row[j] << " ";
+    os << row[dim - 1] << "\n";
 }
 
 
@@ -309,17 +542,19 @@ void Algorithm< T, Set >::writeLog() const
         << inequalityMatrix.nrows() << " processed inequalities.\n";
     if (m_params.verboseLog)
     {
-        size_t dim = inequalityMatrix.ncols();
+        size_t dim = m_input->ncols();
+        std::vector<T> coords(dim);
         for (size_t i = 0; i < extremeRays.size(); ++i)
         {
             Ray* ray = extremeRays[i];
+            liftRay(ray, &coords[0]);
             //*m_params.logStream << "Ray " << ray << "\n";
             //*m_params.logStream << "   Cobasis (incident inequalities): "
             //    << ray->cobasis << "\n";
             //*m_params.logStream << "   Coordinates: (";
             for (size_t j = 0; j < dim - 1; ++j)
-                *m_params.logStream << ray->coordinates[j] << /*", "*/ " ";
-            *m_params.logStream << ray->coordinates[dim - 1] << /*")\n"*/ "\n";
+                *m_params.logStream << coords[j] << /*", "*/ " ";
+            *m_params.logStream << coords[dim - 1] << /*")\n"*/ "\n";
             //*m_params.logStream << "   Adjacent rays:";
             //for (size_t j = 0; j < ray->adjacentRays.size(); ++j)
             //     *m_params.logStream << " " << ray->adjacentRays[j];
@@ -334,6 +569,216 @@ void Algorithm< T, Set >::writeLog() const
 }
 
 
+/* Checkpoints are due each given number of iterations or seconds. */
+template< typename T, typename Set >
+bool Algorithm< T, Set >::isCheckpointDue() const
+{
+    if (m_params.checkpointFile.empty())
+        return false;
+    if (m_params.checkpointIterations)
+        return pivoting.getStep() >=
+            lastCheckpointStep + m_params.checkpointIterations;
+    return difftime(time(0), lastCheckpointTime) >=
+        (double)m_params.checkpointSeconds;
+}
+
+
+/* Format version, arithmetic and params a checkpoint depends on. */
+template< typename T, typename Set >
+std::string Algorithm< T, Set >::checkpointSignature() const
+{
+    std::ostringstream signature;
+    signature << "qskeleton checkpoint 3, " << sizeof(T) << "-byte "
+        << (m_intArith ? "integer" : "floating-point") << " arithmetic, "
+        << m_params.pivotingOrder << " order, plusplus "
+        << (m_params.usePlusPlus ? "on" : "off");
+    return signature.str();
+}
+
+
+/* Write state after iteration to checkpoint file: input, presolved, reordered
+and projected inequalities with their input indexes, basis, lifting basis,
+rays with pointers replaced by indexes in extremeRays and pivoting state.
+File is written under temporary name and then renamed, so crash during writing
+keeps the previous checkpoint. */
+template< typename T, typename Set >
+void Algorithm< T, Set >::writeCheckpoint()
+{
+    summary.startCheckpointing();
+    const std::string tempFile = m_params.checkpointFile + ".tmp";
+    std::vector<char> buffer(1 << 22);
+    std::ofstream os;
+    os.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+    os.open(tempFile.c_str(), std::ios::binary | std::ios::trunc);
+
+    const std::string signature = checkpointSignature();
+    writeBinary(os, (uint32_t)signature.size());
+    writeBinary(os, signature.data(), signature.size());
+    writeBinaryMatrix(os, *m_input);
+    writeBinaryMatrix(os, inequalityMatrix);
+    for (size_t i = 0; i < inequalityIndexes.size(); ++i)
+        writeBinary(os, (uint64_t)inequalityIndexes[i]);
+    writeBinaryMatrix(os, m_bas);
+    writeBinaryMatrix(os, m_lift);
+    writeBinary(os, (uint64_t)m_rank);
+
+    // number rays by their positions
+    std::vector<uint32_t> rayIndexes;
+    for (size_t i = 0; i < extremeRays.size(); ++i)
+    {
+        if (extremeRays[i]->id >= rayIndexes.size())
+            rayIndexes.resize(extremeRays[i]->id + 1);
+        rayIndexes[extremeRays[i]->id] = (uint32_t)i;
+    }
+
+    // rays and then their adjacency, so that all rays exist when it is read
+    const size_t extendedDim = inequalityMatrix.ncols() +
+        (m_params.usePlusPlus ? inequalityMatrix.nrows() : 0);
+    writeBinary(os, (uint64_t)extremeRays.size());
+    for (size_t i = 0; i < extremeRays.size(); ++i)
+    {
+        const Ray* ray = extremeRays[i];
+        writeBinary(os, ray->coordinates, extendedDim);
+        Vector<size_t> cobasis = ray->cobasis.toVector();
+        writeBinary(os, (uint32_t)cobasis.size());
+        for (size_t j = 0; j < cobasis.size(); ++j)
+            writeBinary(os, (uint32_t)cobasis[j]);
+        writeBinary(os, (uint32_t)ray->assignedInequalities.size());
+        for (size_t j = 0; j < ray->assignedInequalities.size(); ++j)
+            writeBinary(os, (uint32_t)ray->assignedInequalities[j]);
+    }
+    for (size_t i = 0; i < extremeRays.size(); ++i)
+    {
+        const Ray* ray = extremeRays[i];
+        writeBinary(os, (uint32_t)ray->adjacentRays.size());
+        for (size_t j = 0; j < ray->adjacentRays.size(); ++j)
+            writeBinary(os, rayIndexes[ray->adjacentRays[j]->id]);
+    }
+    pivoting.writeState(os, rayIndexes);
+    os.close();
+
+    bool succeed = !os.fail() &&
+        !std::rename(tempFile.c_str(), m_params.checkpointFile.c_str());
+    // rename doesn't replace existing files on some systems
+    if (!succeed && !os.fail())
+    {
+        std::remove(m_params.checkpointFile.c_str());
+        succeed = !std::rename(tempFile.c_str(),
+            m_params.checkpointFile.c_str());
+    }
+    if (succeed)
+        *m_params.logStream << "Checkpoint written to "
+            << m_params.checkpointFile << ".\n";
+    else
+        std::cerr << "WARNING: couldn't write checkpoint "
+            << m_params.checkpointFile << ".\n";
+    lastCheckpointStep = pivoting.getStep();
+    lastCheckpointTime = time(0);
+    summary.endCheckpointing();
+}
+
+
+/* Check that checkpoint is made for the same input and params and read
+presolved and reordered inequalities, return if succeeded. */
+template< typename T, typename Set >
+bool Algorithm< T, Set >::readCheckpointHeader(std::istream& is)
+{
+    uint32_t signatureSize;
+    if (!readBinary(is, signatureSize))
+        return false;
+    std::string signature(signatureSize, ' ');
+    if (!readBinary(is, &signature[0], signatureSize) ||
+        (signature != checkpointSignature()))
+        return false;
+    Matrix<T> input;
+    if (!readBinaryMatrix(is, input) || (input.nrows() != m_input->nrows()) ||
+        (input.ncols() != m_input->ncols()))
+        return false;
+    for (size_t i = 0; i < input.nrows(); ++i)
+        for (size_t j = 0; j < input.ncols(); ++j)
+            if (input(i, j) != (*m_input)(i, j))
+                return false;
+    if (!readBinaryMatrix(is, inequalityMatrix) ||
+        (inequalityMatrix.nrows() > input.nrows()) ||
+        (inequalityMatrix.ncols() > input.ncols()))
+        return false;
+    inequalityIndexes.resize(inequalityMatrix.nrows());
+    for (size_t i = 0; i < inequalityIndexes.size(); ++i)
+    {
+        uint64_t idx;
+        if (!readBinary(is, idx) || (idx >= input.nrows()))
+            return false;
+        inequalityIndexes[i] = (size_t)idx;
+    }
+    return true;
+}
+
+
+/* Read basis, rays and pivoting state from checkpoint, return if
+succeeded. */
+template< typename T, typename Set >
+bool Algorithm< T, Set >::readCheckpoint(std::istream& is)
+{
+    uint64_t rank, numRays;
+    if (!readBinaryMatrix(is, m_bas) || !readBinaryMatrix(is, m_lift) ||
+        !readBinary(is, rank))
+        return false;
+    if (m_lift.nrows() ? ((m_lift.nrows() != inequalityMatrix.ncols()) ||
+        (m_lift.ncols() != m_input->ncols())) :
+        (inequalityMatrix.ncols() != m_input->ncols()))
+        return false;
+    m_rank = (size_t)rank;
+    createRayFactory();
+
+    const size_t numInequalities = inequalityMatrix.nrows();
+    const size_t dim = inequalityMatrix.ncols();
+    const size_t extendedDim = dim +
+        (m_params.usePlusPlus ? numInequalities : 0);
+    std::vector<T> coords(extendedDim);
+    if (!readBinary(is, numRays))
+        return false;
+    for (uint64_t i = 0; i < numRays; ++i)
+    {
+        if (!readBinary(is, &coords[0], extendedDim))
+            return false;
+        Ray* ray = rayFactory->newRay(&coords[0], &coords[0] + dim,
+            numInequalities);
+        extremeRays.push_back(ray);
+        uint32_t size, idx;
+        if (!readBinary(is, size))
+            return false;
+        for (uint32_t j = 0; j < size; ++j)
+        {
+            if (!readBinary(is, idx) || (idx >= numInequalities))
+                return false;
+            ray->cobasis.add(idx);
+        }
+        if (!readBinary(is, size))
+            return false;
+        for (uint32_t j = 0; j < size; ++j)
+        {
+            if (!readBinary(is, idx) || (idx >= numInequalities))
+                return false;
+            ray->assignedInequalities.push_back(idx);
+        }
+    }
+    for (size_t i = 0; i < extremeRays.size(); ++i)
+    {
+        uint32_t size, idx;
+        if (!readBinary(is, size))
+            return false;
+        for (uint32_t j = 0; j < size; ++j)
+        {
+            if (!readBinary(is, idx) || (idx >= extremeRays.size()))
+                return false;
+            extremeRays[i]->adjacentRays.push_back(extremeRays[idx]);
+        }
+    }
+    summary.addRays(extremeRays.size());
+    return pivoting.readState(is, extremeRays);
+}
+
+
 } // namespace DDM
 
 
@@ -0,0 +1,200 @@
+#ifndef QDDM_BIT_PATTERN_TREE_HPP
+#define QDDM_BIT_PATTERN_TREE_HPP
+
+
+#include "Ray.hpp"
+
+#include <algorithm>
+#include <vector>
+
+
+namespace DDM
+{
+
+
+/* Bit-pattern tree over cobasis sets of rays for finding rays with large
+common cobasis without comparing all pairs. Each node covers a range of rays
+and keeps the union of their cobases, so a subtree is skipped when even the
+union has too small intersection with the query cobasis. Inner nodes split
+their rays by incidence to an inequality that divides them most evenly. */
+template <typename T, typename Set>
+class BitPatternTree
+{
+public:
+
+    typedef Ray<T, Set> Ray;
+
+    BitPatternTree(): rays(0) {}
+    ~BitPatternTree() { clear(); }
+
+    void build(const Vector<Ray*>& rays, size_t numInequalities);
+    void clear();
+
+    size_t findIntersecting(size_t rayIdx, size_t minIntersection,
+        Vector<size_t>& result) const;
+
+private:
+
+    struct Node
+    {
+        Set* cobasisUnion;
+        size_t begin, end; // range in order
+        size_t maxRayIdx;
+        size_t left, right; // children, 0 for leaves as root is never a child
+    };
+
+    static const size_t maxLeafSize = 16;
+
+    const Vector<Ray*>* rays;
+    std::vector<Node> nodes;
+    std::vector<size_t> order; // ray indexes, grouped by nodes
+
+    // copy and assignment are forbidden, no implementation:
+    BitPatternTree(const BitPatternTree&);
+    BitPatternTree& operator =(const BitPatternTree&);
+};
+
+
+/* Build tree for given rays, they must not change until tree is cleared. */
+template <typename T, typename Set>
+void BitPatternTree<T, Set>::build(const Vector<Ray*>& _rays,
+    size_t numInequalities)
+{
+    clear();
+    rays = &_rays;
+    const size_t numRays = _rays.size();
+    if (!numRays)
+        return;
+
+    // Cobases as sorted lists, i-th is elements[offsets[i] .. offsets[i + 1]).
+    std::vector<size_t> elements, offsets(numRays + 1, 0);
+    for (size_t i = 0; i < numRays; ++i)
+    {
+        Vector<size_t> cobasis = _rays[i]->cobasis.toVector();
+        for (size_t j = 0; j < cobasis.size(); ++j)
+            elements.push_back(cobasis[j]);
+        offsets[i + 1] = elements.size();
+    }
+
+    order.resize(numRays);
+    for (size_t i = 0; i < numRays; ++i)
+        order[i] = i;
+    std::vector<size_t> counts(numInequalities, 0);
+    std::vector<size_t> stack;
+    Node root = {0, 0, numRays, 0, 0, 0};
+    nodes.push_back(root);
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        size_t nodeIdx = stack.back();
+        stack.pop_back();
+        const size_t begin = nodes[nodeIdx].begin, end = nodes[nodeIdx].end;
+        Set* cobasisUnion = new Set(0);
+        size_t maxRayIdx = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            cobasisUnion->unite((*rays)[order[i]]->cobasis);
+            maxRayIdx = std::max(maxRayIdx, order[i]);
+        }
+        nodes[nodeIdx].cobasisUnion = cobasisUnion;
+        nodes[nodeIdx].maxRayIdx = maxRayIdx;
+        if (end - begin <= maxLeafSize)
+            continue;
+
+        // Find inequality incident to closest to half of the rays.
+        for (size_t i = begin; i < end; ++i)
+            for (size_t j = offsets[order[i]]; j < offsets[order[i] + 1]; ++j)
+                ++counts[elements[j]];
+        size_t splitIne = 0, bestBalance = end - begin;
+        for (size_t i = begin; i < end; ++i)
+            for (size_t j = offsets[order[i]]; j < offsets[order[i] + 1]; ++j)
+            {
+                size_t count = counts[elements[j]];
+                size_t balance = (2 * count > end - begin) ?
+                    2 * count - (end - begin) : (end - begin) - 2 * count;
+                if (balance < bestBalance)
+                {
+                    bestBalance = balance;
+                    splitIne = elements[j];
+                }
+            }
+        for (size_t i = begin; i < end; ++i)
+            for (size_t j = offsets[order[i]]; j < offsets[order[i] + 1]; ++j)
+                counts[elements[j]] = 0;
+        // all rays have the same cobasis, nothing to split by
+        if (bestBalance == end - begin)
+            continue;
+
+        size_t middle = begin;
+        for (size_t i = begin; i < end; ++i)
+            if (std::binary_search(elements.begin() + offsets[order[i]],
+                elements.begin() + offsets[order[i] + 1], splitIne))
+                std::swap(order[i], order[middle++]);
+        Node left = {0, begin, middle, 0, 0, 0};
+        Node right = {0, middle, end, 0, 0, 0};
+        nodes[nodeIdx].left = nodes.size();
+        nodes.push_back(left);
+        nodes[nodeIdx].right = nodes.size();
+        nodes.push_back(right);
+        stack.push_back(nodes[nodeIdx].left);
+        stack.push_back(nodes[nodeIdx].right);
+    }
+}
+
+
+template <typename T, typename Set>
+void BitPatternTree<T, Set>::clear()
+{
+    for (size_t i = 0; i < nodes.size(); ++i)
+        delete nodes[i].cobasisUnion;
+    nodes.clear();
+    order.clear();
+    rays = 0;
+}
+
+
+/* Find all rays with indexes greater than rayIdx having at least
+minIntersection common cobasis elements with the ray rayIdx, put their indexes
+to result in increasing order. Return number of rays compared directly. */
+template <typename T, typename Set>
+size_t BitPatternTree<T, Set>::findIntersecting(size_t rayIdx,
+    size_t minIntersection, Vector<size_t>& result) const
+{
+    size_t numComparisons = 0;
+    if (nodes.empty())
+        return numComparisons;
+    const Set& cobasis = (*rays)[rayIdx]->cobasis;
+    std::vector<size_t> stack;
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        if ((node.maxRayIdx <= rayIdx) ||
+            (intersectionSize(cobasis, *node.cobasisUnion) < minIntersection))
+            continue;
+        if (node.left)
+        {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+            continue;
+        }
+        for (size_t i = node.begin; i < node.end; ++i)
+            if (order[i] > rayIdx)
+            {
+                ++numComparisons;
+                if (intersectionSize(cobasis, (*rays)[order[i]]->cobasis) >=
+                    minIntersection)
+                    result.push_back(order[i]);
+            }
+    }
+    if (result.size())
+        std::sort(&result[0], &result[0] + result.size());
+    return numComparisons;
+}
+
+
+} // namespace DDM
+
+
+#endif
@@ -54,13 +54,15 @@ private:
 };
 
 
-/* Supported pivoting orders. */
+/* Supported pivoting orders. Cutoff orders choose the inequality by the
+number of current rays it cuts off: the most, the least or the most one-sided
+split of rays. */
 class PivotingOrder
 {
 public:
 
     enum Order {Quickhull, MinIndex, MaxIndex, LexMin, LexMax, Random,
-        numOrders};
+        MaxCutoff, MinCutoff, MixCutoff, numOrders};
 
     PivotingOrder(Order _order = Order(0)):
         order(_order)
@@ -79,7 +81,10 @@ public:
     { return !(*this == p); }
 
     bool isStatic() const
-    { return (order != Quickhull); }
+    { return (order >= MinIndex) && (order <= Random); }
+
+    bool isDynamic() const
+    { return (order >= MaxCutoff) && (order <= MixCutoff); }
 
     static std::vector<std::string> names()
     {
@@ -90,6 +95,9 @@ public:
         ns[LexMin] = "lexmin";
         ns[LexMax]= "lexmax";
         ns[Random]= "random";
+        ns[MaxCutoff] = "maxcutoff";
+        ns[MinCutoff] = "mincutoff";
+        ns[MixCutoff] = "mixcutoff";
         return ns;
     }
 
@@ -150,17 +158,45 @@ struct Parameters
         verboseLog(false),
         logStream(&std::cout),
         summaryStream(&std::cout),
-        usePlusPlus(false)
+        outputStream(0),
+        usePlusPlus(false),
+        furthestAssignment(false),
+        discrepancyCacheMegabytes(0),
+        numThreads(1),
+        exactSigns(false),
+        presolve(true),
+        checkpointIterations(0),
+        checkpointSeconds(600),
+        resume(false)
     {}
 
     AdjacencyTest adjacencyTest;
     PivotingOrder pivotingOrder;
     SetRepresentation setRepresentation;
     bool usePlusPlus;
+    bool furthestAssignment; // give inequalities to rays violating them most
+    // memory for discrepancies of rays kept between steps, 0 to compute them
+    // when needed, plusplus keeps all of them anyway
+    size_t discrepancyCacheMegabytes;
+    size_t numThreads; // threads for adjacency and classifying rays, needs OpenMP
+    bool exactSigns; // certify signs close to zero, for floating-point only
+    bool presolve; // remove zero and duplicate inequalities
+
+    // Checkpoint is written each checkpointIterations iterations if it is not
+    // 0, otherwise each checkpointSeconds seconds, disabled for empty file.
+    std::string checkpointFile;
+    size_t checkpointIterations;
+    size_t checkpointSeconds;
+    bool resume; // start from checkpointFile
+
+    // directory for memory-mapped file with ray coordinates, empty to keep
+    // them in memory
+    std::string spillDirectory;
 
     bool verboseLog;
     std::ostream* logStream;
     std::ostream* summaryStream;
+    std::ostream* outputStream; // if set, rays are written to it, not to matrix
 
     friend std::ostream& operator <<(std::ostream& os, const Parameters& p)
     {
@@ -169,6 +205,28 @@ struct Parameters
         os << "    adjacency test: " << p.adjacencyTest<< "\n";
         os << "    set type: " << p.setRepresentation << "\n";
         os << "    plusplus: " << (p.usePlusPlus ? "on" : "off") << "\n";
+        os << "    furthest assignment: " << (p.furthestAssignment ? "on" : "off")
+            << "\n";
+        os << "    discrepancy cache: ";
+        if (p.discrepancyCacheMegabytes)
+            os << p.discrepancyCacheMegabytes << " MB\n";
+        else
+            os << "off\n";
+        os << "    threads: " << p.numThreads << "\n";
+        os << "    exact signs: " << (p.exactSigns ? "on" : "off") << "\n";
+        os << "    presolve: " << (p.presolve ? "on" : "off") << "\n";
+        os << "    checkpoint: ";
+        if (p.checkpointFile.empty())
+            os << "off\n";
+        else if (p.checkpointIterations)
+            os << p.checkpointFile << " every " << p.checkpointIterations
+                << " iterations\n";
+        else
+            os << p.checkpointFile << " every " << p.checkpointSeconds
+                << " seconds\n";
+        os << "    resume: " << (p.resume ? "on" : "off") << "\n";
+        os << "    spill: " << (p.spillDirectory.empty() ? "off" :
+            p.spillDirectory) << "\n";
         return os;
     }
 };
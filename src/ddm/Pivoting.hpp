@@ -2,12 +2,29 @@
 #define QDDM_PIVOTING_HPP
 
 
+#include "BinaryIO.hpp"
+#include "BitArray.hpp"
+#include "DotProduct.hpp"
 #include "Matrix.hpp"
 #include "Ray.hpp"
+#include "SignFilter.hpp"
 #include "Summary.hpp"
+using Utils::BitArray;
+using Utils::dotProduct;
+using Utils::dotProducts;
 using Utils::Matrix;
+using Utils::readBinary;
+using Utils::writeBinary;
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <string>
+#include <vector>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
 
 
 namespace DDM
@@ -22,92 +39,163 @@ public:
     typedef Ray<T, Set> Ray;
     typedef typename Set::value_type Idx;
 
-    Pivoting(PivotingOrder _order, bool _storeDiscrepancies, Summary * _summary):
+    Pivoting(PivotingOrder _order, bool _storeDiscrepancies,
+        bool _furthestAssignment, size_t _numThreads, Summary * _summary):
         order(_order),
         storeDiscrepancies(_storeDiscrepancies),
+        furthestAssignment(_furthestAssignment),
+        numThreads(_numThreads),
         summary(_summary),
         pivotRay(0),
         pivotInequalityIdx(0),
         step(0),
-        numProcessedInequalities(0)
+        numProcessedInequalities(0),
+        cutoffFraction(0),
+        cacheBegin(0),
+        cacheSize(0),
+        cacheBudget(0),
+        discrepanciesKnown(false),
+        signFilter(0),
+        worklistValid(true),
+        cutoffCountsValid(false)
     {}
 
+    ~Pivoting() { delete signFilter; }
+
     void setInequalityMatrix(Matrix<T>* matrix)
     {
         inequalityMatrix = matrix;
         assigneeRays.resize(inequalityMatrix->nrows());
+        inequalityRows.resize(inequalityMatrix->nrows());
+        if (order.isDynamic())
+        {
+            minusCounts.assign(inequalityMatrix->nrows(), 0);
+            plusCounts.assign(inequalityMatrix->nrows(), 0);
+        }
+        notProcessedInequalities.assign(inequalityMatrix->nrows(), true);
         for (size_t i = 0; i < inequalityMatrix->nrows(); ++i)
-            notProcessedInequalities.push_back(i);
+            inequalityRows[i] = inequalityMatrix->row(i);
     }
 
-    void reorderInequalities(Matrix<T>& inequalities);
+    // rows of inequalities are reordered together with their indexes
+    void reorderInequalities(Matrix<T>& inequalities,
+        std::vector<size_t>& indexes);
 
-    void computeDiscrepancies(const T* coords, T* disc)
+    /* Decide signs of discrepancies within tolerance exactly, comparisons
+    with zerotol then become comparisons with zero. Call after setting
+    inequality matrix and zerotol. */
+    void enableSignFilter()
     {
-        for (size_t i = 0; i < inequalityMatrix->nrows(); ++i)
+        signFilter = new SignFilter<T>(*inequalityMatrix, zerotol);
+        filterZerotol = zerotol;
+        zerotol = 0;
+    }
+
+    /* Replace discrepancy by value of exact sign if filter is enabled and
+    floating-point value is not certain. */
+    void settleSign(T& disc, const Ray* ray, Idx inequalityIdx)
+    {
+        if (!signFilter || signFilter->isCertain(disc, inequalityIdx))
+            return;
+        summary->addExactSign();
+        using std::abs;
+        int sign = signFilter->exactSign(ray->cobasis, ray->coordinates,
+            ray->id, inequalityIdx);
+        if (sign == SignFilter<T>::Unknown)
         {
-            const T* inequality = inequalityMatrix->row(i);
-            disc[i] = 0;
-            for (size_t j = 0; j < inequalityMatrix->ncols(); ++j)
-                disc[i] += coords[j] * inequality[j];
+            // cobasis is not enough, decide by tolerance
+            if (abs(disc) <= filterZerotol)
+                disc = 0;
         }
+        else if (!sign)
+            disc = 0;
+        else if ((sign > 0) != (disc > 0))
+            disc = (T)sign * std::max(abs(disc), std::numeric_limits<T>::min());
+    }
+
+    /* Cache discrepancies of rays in given number of bytes instead of
+    computing them when needed. Call after setting inequality matrix, not for
+    plusplus, whose discrepancies are always cached, or with sign filter,
+    which certifies only signs of computed dot products. */
+    void enableDiscrepancyCache(size_t budget) { cacheBudget = budget; }
+
+    void computeDiscrepancies(const T* coords, T* disc)
+    {
+        dotProducts(coords, &inequalityRows[0], inequalityRows.size(),
+            inequalityMatrix->ncols(), disc);
     }
 
     T computeDiscrepancy(const Ray* ray, Idx inequalityIdx)
     {
-        //if (storeDiscrepancies)
-        //    return ray->discrepancies[inequalityIdx];
-        //else
+        if (isCached(inequalityIdx))
+            return cachedDiscrepancy(ray, inequalityIdx);
+        return dotProduct(ray->coordinates, inequalityRows[inequalityIdx],
+            inequalityMatrix->ncols());
+    }
+
+    /* Discrepancies of a batch of rays on one inequality. */
+    void computeDiscrepancies(const Ray* const* rays, size_t numRays,
+        Idx inequalityIdx, T* disc)
+    {
+        if (isCached(inequalityIdx))
         {
-            const T* inequality = inequalityMatrix->row(inequalityIdx);
-            T product = 0;
-            for (size_t i = 0; i < inequalityMatrix->ncols(); ++i)
-                product += ray->coordinates[i] * inequality[i];
-            if (storeDiscrepancies && (product != ray->discrepancies[inequalityIdx]))
-                std::cout << "actual = " << product
-                    << " , precomputed = " << ray->discrepancies[inequalityIdx] << "\n";
-            return product;
+            for (size_t i = 0; i < numRays; ++i)
+                disc[i] = cachedDiscrepancy(rays[i], inequalityIdx);
+            return;
         }
+        batchVectors.resize(numRays);
+        for (size_t i = 0; i < numRays; ++i)
+            batchVectors[i] = rays[i]->coordinates;
+        dotProducts(inequalityRows[inequalityIdx], &batchVectors[0], numRays,
+            inequalityMatrix->ncols(), disc);
     }
 
     void next(const Vector<Ray*>& rays)
     {
         step++;
         summary->startSelectingPivot();
+        if (cacheBudget && !order.isStatic() && !cacheSize)
+            fillCache(rays, 0);
         if (order == PivotingOrder::Quickhull)
         {
-            size_t i = 0;
-            for ( ; i < rays.size(); ++i)
-                if (rays[i]->assignedInequalities.size())
-                    break;
-            // if pivot facet exists set its extreme outside ray as pivot
-            // and mark chosen facet as pivot
-            pivotRay = rays[i];
+            if (!worklistValid)
+                rebuildWorklist(rays);
+            // the ray with the furthest outside inequality is pivot, this
+            // inequality is the first assigned to it
+            pivotRay = worklist[0].ray;
             pivotInequalityIdx = pivotRay->assignedInequalities[0];
-            T minDiscrepancy =
-                computeDiscrepancy(pivotRay, pivotInequalityIdx);
-            for (size_t j = 1; j < pivotRay->assignedInequalities.size(); j++)
+            rayFactory->pivotDiscrepancy(pivotRay) = worklist[0].discrepancy;
+        }
+        else if (order.isDynamic())
+        {
+            if (!cutoffCountsValid)
             {
-                T discrepancy = computeDiscrepancy(pivotRay, pivotRay->assignedInequalities[j]);
-                if (discrepancy < minDiscrepancy)
-                {
-                    minDiscrepancy = discrepancy;
-                    pivotInequalityIdx = pivotRay->assignedInequalities[j];
-                }
+                std::fill(minusCounts.begin(), minusCounts.end(), 0);
+                std::fill(plusCounts.begin(), plusCounts.end(), 0);
+                countRays(rays, 1);
+                cutoffCountsValid = true;
             }
-            pivotRay->pivotDiscrepancy = minDiscrepancy;
+            selectByCutoff();
+            pivotRay = assigneeRays[pivotInequalityIdx];
+            rayFactory->pivotDiscrepancy(pivotRay) = computeDiscrepancy(pivotRay, pivotInequalityIdx);
+            settleSign(rayFactory->pivotDiscrepancy(pivotRay), pivotRay,
+                pivotInequalityIdx);
         }
         else
         {
-            // except Quickhull order only static orders are supported
+            // otherwise order is static
             // in each case inequalities are sorted so that pivot ray indexes are
             // sequential in increasing order, skip inequalities for which there are
             // no minus rays
             while (assigneeRays[pivotInequalityIdx] == 0)
                 ++pivotInequalityIdx;
+            if (cacheBudget && !isCached(pivotInequalityIdx))
+                fillCache(rays, pivotInequalityIdx);
             // if there is inequality that must be added mark
             pivotRay = assigneeRays[pivotInequalityIdx];
-            pivotRay->pivotDiscrepancy = computeDiscrepancy(pivotRay, pivotInequalityIdx);
+            rayFactory->pivotDiscrepancy(pivotRay) = computeDiscrepancy(pivotRay, pivotInequalityIdx);
+            settleSign(rayFactory->pivotDiscrepancy(pivotRay), pivotRay,
+                pivotInequalityIdx);
         }
         summary->endSelectingPivot();
     }
@@ -120,37 +208,61 @@ void searchAdj(Ray* ray,
     Vector<Ray*>& zeroRays,
     Vector<Ray*>& newRays)
 {
+    // compute discrepancies of all not yet visited adjacent rays in a batch,
+    // they all are visited below; parallel search has already done it
+    batchRays.clear();
+    for (size_t i = 0; !discrepanciesKnown && (i < ray->adjacentRays.size()); ++i)
+        if (rayFactory->visitingStep(ray->adjacentRays[i]) != step)
+            batchRays.push_back(ray->adjacentRays[i]);
+    if (batchRays.size())
+    {
+        batchDiscrepancies.resize(batchRays.size());
+        computeDiscrepancies(&batchRays[0], batchRays.size(),
+            pivotInequalityIdx, &batchDiscrepancies[0]);
+        for (size_t i = 0; i < batchRays.size(); ++i)
+        {
+            settleSign(batchDiscrepancies[i], batchRays[i], pivotInequalityIdx);
+            rayFactory->pivotDiscrepancy(batchRays[i]) = batchDiscrepancies[i];
+        }
+    }
+
     for (size_t i = 0; i < ray->adjacentRays.size(); )
     {
         Ray* adjRay = ray->adjacentRays[i];
-        // if adyFacet has not been visited on current step, compute dot to
-        // pivot ray
-        if (adjRay->visitingStep != step)
+        // if adyFacet has not been visited on current step, mark it and use
+        // discrepancy computed above
+        if (rayFactory->visitingStep(adjRay) != step)
         {
-            adjRay->visitingStep = step;
-            adjRay->pivotDiscrepancy = computeDiscrepancy(adjRay, pivotInequalityIdx);
-            if (adjRay->pivotDiscrepancy < -zerotol )
+            rayFactory->visitingStep(adjRay) = step;
+            if (rayFactory->pivotDiscrepancy(adjRay) < -zerotol )
                 minusRays.push_back(adjRay);
             else
-                if (adjRay->pivotDiscrepancy <= zerotol)
+                if (rayFactory->pivotDiscrepancy(adjRay) <= zerotol)
                 {
                     adjRay->cobasis.add(pivotInequalityIdx);
                     zeroRays.push_back(adjRay);
                 }
         }
 
-        if (ray->pivotDiscrepancy < -zerotol)
-            if(adjRay->pivotDiscrepancy > zerotol)
+        if (rayFactory->pivotDiscrepancy(ray) < -zerotol)
+            if(rayFactory->pivotDiscrepancy(adjRay) > zerotol)
             {
-                // (-, +) edge, create new ray
-                newRays.push_back(rayFactory->newRay(adjRay, ray, pivotInequalityIdx));
+                // (-, +) edge, create new ray, coordinates are combined
+                // later in parallel if the search is parallel
+                newRays.push_back(rayFactory->newRay(adjRay, ray,
+                    pivotInequalityIdx, !discrepanciesKnown));
+                if (discrepanciesKnown)
+                {
+                    newRayParents.push_back(adjRay);
+                    newRayParents.push_back(ray);
+                }
                 ++i;
             }
             else
                 // (-, -) or (-, 0) edge, remove it
                 ray->adjacentRays.erase(i);
         else
-            if (adjRay->pivotDiscrepancy > zerotol)
+            if (rayFactory->pivotDiscrepancy(adjRay) > zerotol)
                 // (0, +) edge, keep it
                 ++i;
             else
@@ -167,15 +279,39 @@ void searchAdj(Ray* ray,
 
         summary->startClassifyingRays();
         Vector<Ray*> minusRays(extremeRays.size()), newRays(extremeRays.size());
-        pivotRay->visitingStep = step;
-        minusRays.push_back(pivotRay);
-        size_t minusRayIdx = 0, zeroRayIdx = 0;
-        while ((minusRayIdx < minusRays.size()) || (zeroRayIdx < zeroRays.size()))
+        if (useFullScan(extremeRays.size()))
+            scanRays(extremeRays, minusRays, zeroRays, newRays);
+        else
         {
-            Ray* ray = (minusRayIdx < minusRays.size()) ?
-                minusRays[minusRayIdx++] : zeroRays[zeroRayIdx++];
-            searchAdj(ray, minusRays, zeroRays, newRays);
+#ifdef USE_OPENMP
+            if (numThreads > 1)
+                searchParallel();
+#endif
+            rayFactory->visitingStep(pivotRay) = step;
+            minusRays.push_back(pivotRay);
+            size_t minusRayIdx = 0, zeroRayIdx = 0;
+            while ((minusRayIdx < minusRays.size()) || (zeroRayIdx < zeroRays.size()))
+            {
+                Ray* ray = (minusRayIdx < minusRays.size()) ?
+                    minusRays[minusRayIdx++] : zeroRays[zeroRayIdx++];
+                searchAdj(ray, minusRays, zeroRays, newRays);
+            }
+#ifdef USE_OPENMP
+            if (discrepanciesKnown)
+            {
+                const long numNewRays = (long)newRays.size();
+                #pragma omp parallel for num_threads((int)numThreads) \
+                    schedule(dynamic, 16)
+                for (long i = 0; i < numNewRays; ++i)
+                    rayFactory->combineCoordinates(newRays[i],
+                        newRayParents[2 * i], newRayParents[2 * i + 1]);
+                newRayParents.clear();
+                discrepanciesKnown = false;
+            }
+#endif
         }
+        cutoffFraction = (cutoffFraction + (double)(minusRays.size() +
+            zeroRays.size()) / extremeRays.size()) / 2;
         summary->addRays(newRays.size());
         summary->endClassifyingRays();
 
@@ -183,11 +319,22 @@ void searchAdj(Ray* ray,
             zeroRays.push_back(newRays[i]);
         partitionInes(minusRays, zeroRays);
 
+        // zero rays keep their counts, minus rays leave and new rays come
+        if (order.isDynamic())
+        {
+            summary->startSelectingPivot();
+            countRays(minusRays, -1);
+            countRays(newRays, 1);
+            summary->endSelectingPivot();
+        }
+
         // Delete minus rays, add new rays.
         for (size_t i = 0; i < extremeRays.size(); )
         {
-            if (extremeRays[i]->pivotDiscrepancy < -zerotol)
+            if (rayFactory->pivotDiscrepancy(extremeRays[i]) < -zerotol)
             {
+                if (order == PivotingOrder::Quickhull)
+                    removeFromWorklist(extremeRays[i]);
                 rayFactory->deleteRay(extremeRays[i]);
                 extremeRays.erase(i);
             }
@@ -196,9 +343,142 @@ void searchAdj(Ray* ray,
         }
         for (size_t i = 0; i < newRays.size(); ++i)
             extremeRays.push_back(newRays[i]);
+        if (rayFactory->compact() && signFilter)
+            signFilter->clearCache();
+        fitCache(extremeRays);
     }
 
 
+    /* Whether to classify rays by full scan instead of search from pivot ray.
+    Search visits minus and zero rays and their neighbours, so it is chosen
+    unless they are expected to be a large part of rays: the part is known
+    from counts for dynamic orders and is estimated by previous steps for
+    static ones. Quickhull cuts off few rays, it always uses search. */
+    bool useFullScan(size_t numRays) const
+    {
+        // scan of contiguous coordinates is a few times cheaper per ray than
+        // search, which also follows adjacency lists
+        const double minFullScanFraction = 0.3;
+        if (order.isDynamic())
+            return (double)(numRays - plusCounts[pivotInequalityIdx]) >=
+                minFullScanFraction * numRays;
+        return order.isStatic() && (cutoffFraction >= minFullScanFraction);
+    }
+
+    /* Compute pivot discrepancies of all rays in one pass over the arena
+    and list minus and zero rays in the order of rays. Then edges of minus
+    rays to plus rays give new rays, zero rays keep only edges to plus
+    rays, the other edges of minus rays go away with them. */
+    void scanRays(const Vector<Ray*>& rays, Vector<Ray*>& minusRays,
+        Vector<Ray*>& zeroRays, Vector<Ray*>& newRays)
+    {
+        if (isCached(pivotInequalityIdx))
+            for (size_t i = 0; i < rays.size(); ++i)
+                rayFactory->pivotDiscrepancy(rays[i]) =
+                    cachedDiscrepancy(rays[i], pivotInequalityIdx);
+        else
+            rayFactory->computePivotDiscrepancies(
+                inequalityRows[pivotInequalityIdx]);
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            Ray* ray = rays[i];
+            T& disc = rayFactory->pivotDiscrepancy(ray);
+            settleSign(disc, ray, pivotInequalityIdx);
+            if (disc < -zerotol)
+                minusRays.push_back(ray);
+            else if (disc <= zerotol)
+            {
+                ray->cobasis.add(pivotInequalityIdx);
+                zeroRays.push_back(ray);
+            }
+        }
+        for (size_t i = 0; i < minusRays.size(); ++i)
+        {
+            Ray* ray = minusRays[i];
+            for (size_t j = 0; j < ray->adjacentRays.size(); ++j)
+            {
+                Ray* adjRay = ray->adjacentRays[j];
+                if (rayFactory->pivotDiscrepancy(adjRay) > zerotol)
+                    newRays.push_back(rayFactory->newRay(adjRay, ray,
+                        pivotInequalityIdx));
+            }
+        }
+        for (size_t i = 0; i < zeroRays.size(); ++i)
+        {
+            Ray* ray = zeroRays[i];
+            for (size_t j = 0; j < ray->adjacentRays.size(); )
+                if (rayFactory->pivotDiscrepancy(ray->adjacentRays[j]) > zerotol)
+                    ++j;
+                else
+                    ray->adjacentRays.erase(j);
+        }
+    }
+
+#ifdef USE_OPENMP
+    /* Level-synchronous parallel search from pivot ray through minus and zero
+    rays. Threads claim rays by atomic exchange of visiting marks and collect
+    them in their own buffers, pivot discrepancies of each level are computed
+    in parallel. Rays are marked with ~step, so the serial pass in
+    searchAdj() then walks the same rays in the serial order, only editing
+    adjacency and creating new rays, and the result does not depend on the
+    number of threads. */
+    void searchParallel()
+    {
+        const size_t mark = ~step;
+        std::vector<Ray*> frontier(1, pivotRay), level;
+        rayFactory->visitingStep(pivotRay) = mark;
+        std::vector<std::vector<Ray*> > threadRays(numThreads);
+        while (!frontier.empty())
+        {
+            const long numFrontier = (long)frontier.size();
+            #pragma omp parallel num_threads((int)numThreads) \
+                if (numFrontier >= minParallelRays)
+            {
+                std::vector<Ray*>& found = threadRays[omp_get_thread_num()];
+                #pragma omp for schedule(dynamic, 16)
+                for (long i = 0; i < numFrontier; ++i)
+                {
+                    const Ray* ray = frontier[i];
+                    for (size_t j = 0; j < ray->adjacentRays.size(); ++j)
+                    {
+                        Ray* adjRay = ray->adjacentRays[j];
+                        size_t& visitingStep = rayFactory->visitingStep(adjRay);
+                        size_t previous;
+                        #pragma omp atomic capture
+                        { previous = visitingStep; visitingStep = mark; }
+                        if (previous != mark)
+                            found.push_back(adjRay);
+                    }
+                }
+            }
+            level.clear();
+            for (size_t t = 0; t < threadRays.size(); ++t)
+            {
+                level.insert(level.end(), threadRays[t].begin(),
+                    threadRays[t].end());
+                threadRays[t].clear();
+            }
+
+            const long numLevel = (long)level.size();
+            #pragma omp parallel for num_threads((int)numThreads) \
+                schedule(static) if (numLevel >= minParallelRays)
+            for (long i = 0; i < numLevel; ++i)
+                rayFactory->pivotDiscrepancy(level[i]) =
+                    computeDiscrepancy(level[i], pivotInequalityIdx);
+            // exact signs use shared cache, they are settled serially
+            frontier.clear();
+            for (long i = 0; i < numLevel; ++i)
+            {
+                T& disc = rayFactory->pivotDiscrepancy(level[i]);
+                settleSign(disc, level[i], pivotInequalityIdx);
+                if (disc <= zerotol)
+                    frontier.push_back(level[i]);
+            }
+        }
+        discrepanciesKnown = true;
+    }
+#endif
+
     void partitionInes(Vector<Ray*>& minusRays, Vector<Ray*>& zeroRays)
     {
         summary->startPartitioning();
@@ -208,56 +488,421 @@ void searchAdj(Ray* ray,
         summary->endPartitioning();
     }
 
+    /* Assign inequality to the first ray violating it or, with furthest
+    assignment, to the ray violating it most, ties go to the first such ray.
+    Rays are checked in batches, so a few more dot products than needed may
+    be computed. For Quickhull order the furthest inequality of a ray is kept
+    first in its list and the worklist is updated. */
     void assignIne(Idx ineIdx, Vector<Ray*>& rays)
     {
-        for (size_t i = 0; i < rays.size(); ++i)
+        T disc[assignBatchSize];
+        const bool cached = isCached(ineIdx);
+        Ray* assignee = 0;
+        T assigneeDisc = 0;
+        for (size_t begin = 0; begin < rays.size(); begin += assignBatchSize)
         {
-            summary->addDotproduct();
-            if (computeDiscrepancy(rays[i], ineIdx) < -zerotol)
+            size_t batchSize = std::min(assignBatchSize, rays.size() - begin);
+            computeDiscrepancies(&rays[begin], batchSize, ineIdx, disc);
+            for (size_t i = 0; i < batchSize; ++i)
             {
-                rays[i]->assignedInequalities.push_back(ineIdx);
-                assigneeRays[ineIdx] = rays[i];
-                return;
+                if (!cached)
+                    summary->addDotproduct();
+                settleSign(disc[i], rays[begin + i], ineIdx);
+                if ((disc[i] < -zerotol) && (!assignee || (disc[i] < assigneeDisc)))
+                {
+                    assignee = rays[begin + i];
+                    assigneeDisc = disc[i];
+                }
             }
+            if (assignee && !furthestAssignment)
+                break;
+        }
+        if (assignee)
+        {
+            assignee->assignedInequalities.push_back(ineIdx);
+            assigneeRays[ineIdx] = assignee;
+            if ((order == PivotingOrder::Quickhull) && worklistValid)
+                updateWorklist(assignee, assigneeDisc);
+            return;
         }
         // if inequality is not assigned, it is processed
         assigneeRays[ineIdx] = 0;
         ++numProcessedInequalities;
-        notProcessedInequalities.remove(ineIdx);
+        notProcessedInequalities.reset(ineIdx);
     }
 
     bool isEnded() const
     { return numProcessedInequalities >= inequalityMatrix->nrows(); }
 
+    /* Write state to checkpoint, rays are written as indexes given by
+    rayIndexes[ray id]. */
+    void writeState(std::ostream& os,
+        const std::vector<uint32_t>& rayIndexes) const
+    {
+        writeBinary(os, (uint64_t)step);
+        writeBinary(os, (uint64_t)pivotInequalityIdx);
+        writeBinary(os, (uint64_t)numProcessedInequalities);
+        writeBinary(os, (uint64_t)notProcessedInequalities.count());
+        for (size_t i = notProcessedInequalities.findFirst();
+            i < notProcessedInequalities.size();
+            i = notProcessedInequalities.findNext(i + 1))
+            writeBinary(os, (uint32_t)i);
+        for (size_t i = 0; i < assigneeRays.size(); ++i)
+            writeBinary(os, (uint32_t)(assigneeRays[i] ?
+                rayIndexes[assigneeRays[i]->id] : noRayIndex));
+    }
+
+    /* Read state written by writeState(), rays[index] is the ray with given
+    index. Return if succeeded. */
+    bool readState(std::istream& is, const Vector<Ray*>& rays)
+    {
+        uint64_t value, numNotProcessed;
+        if (!readBinary(is, value))
+            return false;
+        step = (size_t)value;
+        if (!readBinary(is, value))
+            return false;
+        pivotInequalityIdx = (Idx)value;
+        if (!readBinary(is, value) || !readBinary(is, numNotProcessed))
+            return false;
+        numProcessedInequalities = (size_t)value;
+        notProcessedInequalities.assign(inequalityMatrix->nrows(), false);
+        for (uint64_t i = 0; i < numNotProcessed; ++i)
+        {
+            uint32_t ineIdx;
+            if (!readBinary(is, ineIdx) ||
+                (ineIdx >= notProcessedInequalities.size()))
+                return false;
+            notProcessedInequalities.set(ineIdx);
+        }
+        for (size_t i = 0; i < assigneeRays.size(); ++i)
+        {
+            uint32_t rayIdx;
+            if (!readBinary(is, rayIdx) ||
+                ((rayIdx != noRayIndex) && (rayIdx >= rays.size())))
+                return false;
+            assigneeRays[i] = (rayIdx != noRayIndex) ? rays[rayIdx] : 0;
+        }
+        worklistValid = false;
+        cutoffCountsValid = false;
+        return true;
+    }
+
+    static const uint32_t noRayIndex = 0xFFFFFFFF;
+
+    /* Add rays with delta = 1 or remove them with delta = -1 from the numbers
+    of rays with negative and positive discrepancies on each not processed
+    inequality. Discrepancies cached for all inequalities are used, otherwise
+    they are computed in a batch per ray. */
+    void countRays(const Vector<Ray*>& rays, long delta)
+    {
+        countInequalities.clear();
+        for (size_t i = notProcessedInequalities.findFirst();
+            i < notProcessedInequalities.size();
+            i = notProcessedInequalities.findNext(i + 1))
+            countInequalities.push_back(i);
+        const size_t numIne = countInequalities.size();
+        if (!rays.size() || !numIne)
+            return;
+        const T tol = signFilter ? filterZerotol : zerotol;
+        countDiscrepancies.resize(numIne);
+        const bool cached = (cacheSize == inequalityRows.size());
+        if (!cached)
+        {
+            countRows.resize(numIne);
+            for (size_t j = 0; j < numIne; ++j)
+                countRows[j] = inequalityRows[countInequalities[j]];
+        }
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            const Ray* ray = rays[i];
+            if (cached)
+                for (size_t j = 0; j < numIne; ++j)
+                    countDiscrepancies[j] =
+                        ray->discrepancies[countInequalities[j]];
+            else
+            {
+                dotProducts(ray->coordinates, &countRows[0], numIne,
+                    inequalityMatrix->ncols(), &countDiscrepancies[0]);
+                for (size_t j = 0; j < numIne; ++j)
+                    summary->addDotproduct();
+            }
+            for (size_t j = 0; j < numIne; ++j)
+                if (countDiscrepancies[j] < -tol)
+                    minusCounts[countInequalities[j]] += delta;
+                else if (countDiscrepancies[j] > tol)
+                    plusCounts[countInequalities[j]] += delta;
+        }
+    }
+
+    /* Rays with assigned inequalities for Quickhull order in a binary heap by
+    discrepancy of their furthest inequality, the most negative on top.
+    Positions of rays in the heap are kept by RayFactory. */
+    struct WorklistEntry
+    {
+        T discrepancy;
+        Ray* ray;
+    };
+
+    void placeInWorklist(size_t pos, const WorklistEntry& entry)
+    {
+        worklist[pos] = entry;
+        rayFactory->worklistPosition(entry.ray) = pos;
+    }
+
+    void siftUpWorklist(size_t pos)
+    {
+        WorklistEntry entry = worklist[pos];
+        while (pos && (entry.discrepancy < worklist[(pos - 1) / 2].discrepancy))
+        {
+            placeInWorklist(pos, worklist[(pos - 1) / 2]);
+            pos = (pos - 1) / 2;
+        }
+        placeInWorklist(pos, entry);
+    }
+
+    void siftDownWorklist(size_t pos)
+    {
+        WorklistEntry entry = worklist[pos];
+        for (size_t child = 2 * pos + 1; child < worklist.size();
+            child = 2 * pos + 1)
+        {
+            if ((child + 1 < worklist.size()) &&
+                (worklist[child + 1].discrepancy < worklist[child].discrepancy))
+                ++child;
+            if (!(worklist[child].discrepancy < entry.discrepancy))
+                break;
+            placeInWorklist(pos, worklist[child]);
+            pos = child;
+        }
+        placeInWorklist(pos, entry);
+    }
+
+    /* Inequality with given discrepancy has just been assigned to ray as the
+    last one, make it first if it is the furthest. */
+    void updateWorklist(Ray* ray, const T& disc)
+    {
+        size_t pos = rayFactory->worklistPosition(ray);
+        if (pos == RayFactory<T, Set>::noWorklistPosition)
+        {
+            WorklistEntry entry = {disc, ray};
+            worklist.push_back(entry);
+            siftUpWorklist(worklist.size() - 1);
+        }
+        else if (disc < worklist[pos].discrepancy)
+        {
+            Vector<Idx, true>& assigned = ray->assignedInequalities;
+            std::swap(assigned[0], assigned[assigned.size() - 1]);
+            worklist[pos].discrepancy = disc;
+            siftUpWorklist(pos);
+        }
+    }
+
+    void removeFromWorklist(Ray* ray)
+    {
+        size_t pos = rayFactory->worklistPosition(ray);
+        if (pos == RayFactory<T, Set>::noWorklistPosition)
+            return;
+        rayFactory->worklistPosition(ray) = RayFactory<T, Set>::noWorklistPosition;
+        WorklistEntry last = worklist.back();
+        worklist.pop_back();
+        if (pos == worklist.size())
+            return;
+        placeInWorklist(pos, last);
+        siftUpWorklist(pos);
+        siftDownWorklist(rayFactory->worklistPosition(last.ray));
+    }
+
+    /* Make worklist from scratch after resume: discrepancies of all assigned
+    inequalities are computed, the furthest one is moved first. */
+    void rebuildWorklist(const Vector<Ray*>& rays)
+    {
+        worklist.clear();
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            Ray* ray = rays[i];
+            Vector<Idx, true>& assigned = ray->assignedInequalities;
+            const size_t numAssigned = assigned.size();
+            if (!numAssigned)
+                continue;
+            batchVectors.resize(numAssigned);
+            batchDiscrepancies.resize(numAssigned);
+            for (size_t j = 0; j < numAssigned; j++)
+                batchVectors[j] = inequalityRows[assigned[j]];
+            dotProducts(ray->coordinates, &batchVectors[0], numAssigned,
+                inequalityMatrix->ncols(), &batchDiscrepancies[0]);
+            size_t furthest = 0;
+            for (size_t j = 0; j < numAssigned; j++)
+            {
+                settleSign(batchDiscrepancies[j], ray, assigned[j]);
+                if (batchDiscrepancies[j] < batchDiscrepancies[furthest])
+                    furthest = j;
+            }
+            std::swap(assigned[0], assigned[furthest]);
+            WorklistEntry entry = {batchDiscrepancies[furthest], ray};
+            worklist.push_back(entry);
+            siftUpWorklist(worklist.size() - 1);
+        }
+        worklistValid = true;
+    }
+
+    /* Set pivot to the not processed inequality cutting off the most or the
+    least rays or, for MixCutoff, splitting them most unevenly. Ties go to
+    the smallest index. */
+    void selectByCutoff()
+    {
+        bool found = false;
+        long bestScore = 0;
+        for (size_t idx = notProcessedInequalities.findFirst();
+            idx < notProcessedInequalities.size();
+            idx = notProcessedInequalities.findNext(idx + 1))
+        {
+            if (!assigneeRays[idx])
+                continue;
+            long score = minusCounts[idx];
+            if (order == PivotingOrder::MinCutoff)
+                score = -score;
+            else if (order == PivotingOrder::MixCutoff)
+                score = std::max(minusCounts[idx], plusCounts[idx]);
+            if (!found || (score > bestScore))
+            {
+                found = true;
+                bestScore = score;
+                pivotInequalityIdx = (Idx)idx;
+            }
+        }
+    }
+
+    bool isCached(Idx inequalityIdx) const
+    {
+        // sign filter certifies only directly computed discrepancies
+        return !signFilter && ((size_t)inequalityIdx - cacheBegin < cacheSize);
+    }
+
+    T cachedDiscrepancy(const Ray* ray, Idx inequalityIdx) const
+    { return ray->discrepancies[inequalityIdx - cacheBegin]; }
+
+    /* Cache discrepancies of all rays on inequalities from given one on, as
+    many as fit in the budget. Only orders with static pivots can use part of
+    them, for other orders cache is disabled if not all of them fit. */
+    void fillCache(const Vector<Ray*>& rays, Idx firstIdx)
+    {
+        const size_t numRays = std::max(rays.size(), (size_t)1);
+        size_t size = std::min(cacheBudget / (sizeof(T) * numRays),
+            inequalityRows.size() - firstIdx);
+        if (!order.isStatic() && (size < inequalityRows.size()))
+            cacheBudget = size = 0;
+        else if (size < minCacheSize)
+            size = 0;
+        cacheBegin = firstIdx;
+        cacheSize = size;
+        rayFactory->setNumDiscrepancies(size);
+        if (!size)
+            return;
+        const long numFilled = (long)rays.size();
+#ifdef USE_OPENMP
+        #pragma omp parallel for num_threads((int)numThreads) \
+            schedule(dynamic, 16) if (numFilled >= minParallelRays)
+#endif
+        for (long i = 0; i < numFilled; ++i)
+            dotProducts(rays[i]->coordinates, &inequalityRows[firstIdx], size,
+                inequalityMatrix->ncols(), rays[i]->discrepancies);
+    }
+
+    /* Shrink cache if rays have outgrown the budget, static orders keep the
+    discrepancies on the first inequalities that still fit. */
+    void fitCache(const Vector<Ray*>& rays)
+    {
+        if (!cacheBudget || (cacheSize * sizeof(T) * rays.size() <= cacheBudget))
+            return;
+        size_t size = cacheBudget / (sizeof(T) * rays.size());
+        if (!order.isStatic())
+            cacheBudget = size = 0;
+        else if (size < minCacheSize)
+            size = 0;
+        cacheSize = size;
+        rayFactory->setNumDiscrepancies(size);
+    }
+
     size_t getStep() const { return step; }
-    Idx getNumProcessedInequalities() const { return numProcessedInequalities; }
+    size_t getNumProcessedInequalities() const { return numProcessedInequalities; }
 
     void setZerotol(T value) { zerotol = value; }
-    void setRayFactory(RayFactory<T, Set>* value) { rayFactory = value; }
 
-    Vector<Idx> notProcessedInequalities;
+    /* Rays of a new factory have all discrepancies for plusplus and none
+    otherwise. */
+    void setRayFactory(RayFactory<T, Set>* value)
+    {
+        rayFactory = value;
+        cacheBegin = 0;
+        cacheSize = storeDiscrepancies ? inequalityRows.size() : 0;
+    }
+
+    BitArray notProcessedInequalities;
 private:
 
     PivotingOrder order;
+    size_t numThreads; // for classifying rays, needs OpenMP
     Summary * summary;
     size_t step;
     Ray* pivotRay;
     Idx pivotInequalityIdx;
-    Idx numProcessedInequalities;
+    size_t numProcessedInequalities; // may be 1 more than maximal Idx value
+    // running estimate of the part of rays that are minus or zero on pivot
+    double cutoffFraction;
 
     Matrix<T>* inequalityMatrix;
     T zerotol;
     RayFactory<T, Set>* rayFactory;
     bool storeDiscrepancies;
+    bool furthestAssignment; // assign inequalities to most violating rays
+
+    // Rays cache discrepancies on cacheSize inequalities from cacheBegin on,
+    // in at most cacheBudget bytes, 0 if cache is off or fixed for plusplus.
+    // A smaller window than minCacheSize would be refilled too often.
+    size_t cacheBegin;
+    size_t cacheSize;
+    size_t cacheBudget;
+    static const size_t minCacheSize = 8;
 
     // A ray inequality is assigned to, NULL if no ray.
     std::vector<Ray*> assigneeRays;
+
+    // Exact sign filter, NULL if disabled, and tolerance it replaces.
+    SignFilter<T>* signFilter;
+    T filterZerotol;
+
+    // Rows of inequality matrix and buffers for batched dot products.
+    static const size_t assignBatchSize = 16;
+    std::vector<const T*> inequalityRows;
+    std::vector<const T*> batchVectors;
+    std::vector<T> batchDiscrepancies;
+    std::vector<Ray*> batchRays;
+
+    // Parallel search has computed pivot discrepancies of this step, new
+    // rays then wait for coordinates, their plus and minus rays are in pairs.
+    bool discrepanciesKnown;
+    std::vector<Ray*> newRayParents;
+    static const long minParallelRays = 16;
+
+    std::vector<WorklistEntry> worklist;
+    bool worklistValid;
+
+    // Numbers of current rays with negative and positive discrepancy on each
+    // inequality for dynamic orders, recounted from scratch when not valid,
+    // and buffers for counting.
+    std::vector<long> minusCounts, plusCounts;
+    bool cutoffCountsValid;
+    std::vector<size_t> countInequalities;
+    std::vector<const T*> countRows;
+    std::vector<T> countDiscrepancies;
 };
 
 
 
 template <typename T, typename Set>
-void Pivoting<T, Set>::reorderInequalities(Matrix<T>& inequalities)
+void Pivoting<T, Set>::reorderInequalities(Matrix<T>& inequalities,
+    std::vector<size_t>& indexes)
 {
     if ((order == PivotingOrder::LexMin) || (order == PivotingOrder::LexMax))
     {
@@ -279,14 +924,22 @@ void Pivoting<T, Set>::reorderInequalities(Matrix<T>& inequalities)
                             break;
                 }
                 inequalities.swap_rows(i, lexMinRowIdx);
+                std::swap(indexes[i], indexes[lexMinRowIdx]);
         }
     }
     if ((order == PivotingOrder::MaxIndex) || (order == PivotingOrder::LexMax))
         for (size_t i = 0; i < inequalities.nrows() / 2; i++)
+        {
             inequalities.swap_rows(i, inequalities.nrows() - 1 - i);
+            std::swap(indexes[i], indexes[inequalities.nrows() - 1 - i]);
+        }
     if (order == PivotingOrder::Random)
         for (size_t i = 0; i < inequalities.nrows(); i++)
-            inequalities.swap_rows(i, rand() % inequalities.nrows());
+        {
+            size_t j = rand() % inequalities.nrows();
+            inequalities.swap_rows(i, j);
+            std::swap(indexes[i], indexes[j]);
+        }
 }
 
 
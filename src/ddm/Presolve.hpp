@@ -0,0 +1,96 @@
+#ifndef QDDM_PRESOLVE_HPP
+#define QDDM_PRESOLVE_HPP
+
+
+#include "Gcd.hpp"
+#include "Matrix.hpp"
+using Utils::Matrix;
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+
+namespace DDM
+{
+
+
+/* Strict weak order of rows by their elements, used to bring equal rows
+together. */
+template <typename T>
+class RowLess
+{
+public:
+
+    RowLess(const Matrix<T>& _rows): rows(_rows) {}
+
+    bool operator ()(size_t i, size_t j) const
+    {
+        return std::lexicographical_compare(rows.row(i),
+            rows.row(i) + rows.ncols(), rows.row(j), rows.row(j) + rows.ncols());
+    }
+
+private:
+
+    const Matrix<T>& rows;
+};
+
+
+/* Remove zero inequalities and duplicates up to positive scaling, the first
+of equal inequalities is kept. Rows are compared after normalization by gcd
+for integers or by maximal absolute value otherwise, rows within zerotol of
+zero are zero. Order of the remaining rows is kept, indexes[i] is the original
+index of the i-th of them. Return number of removed rows. */
+template <typename T>
+size_t presolveInequalities(Matrix<T>& inequalities,
+    std::vector<size_t>& indexes, bool intArith, const T& zerotol)
+{
+    using std::abs;
+    const size_t n = inequalities.nrows();
+    const size_t d = inequalities.ncols();
+    Matrix<T> normalized(inequalities);
+    std::vector<bool> isRemoved(n, false);
+    for (size_t i = 0; i < n; ++i)
+    {
+        bool isZero = true;
+        for (size_t j = 0; (j < d) && isZero; ++j)
+            isZero = abs(normalized(i, j)) <= zerotol;
+        if (isZero)
+            isRemoved[i] = true;
+        else if (intArith)
+            Utils::normalizeIntVector(normalized.row(i), d);
+        else
+            Utils::normalizeFPVector(normalized.row(i), d);
+    }
+
+    // equal rows are neighbours after sorting, stable so the first is kept
+    std::vector<size_t> order;
+    for (size_t i = 0; i < n; ++i)
+        if (!isRemoved[i])
+            order.push_back(i);
+    std::stable_sort(order.begin(), order.end(), RowLess<T>(normalized));
+    for (size_t k = 1; k < order.size(); ++k)
+        if (std::equal(normalized.row(order[k]), normalized.row(order[k]) + d,
+            normalized.row(order[k - 1])))
+            isRemoved[order[k]] = true;
+
+    indexes.clear();
+    for (size_t i = 0; i < n; ++i)
+        if (!isRemoved[i])
+            indexes.push_back(i);
+    if (indexes.size() == n)
+        return 0;
+    Matrix<T> remaining(indexes.size(), d);
+    for (size_t i = 0; i < indexes.size(); ++i)
+        std::copy(inequalities.row(indexes[i]), inequalities.row(indexes[i]) + d,
+            remaining.row(i));
+    inequalities = std::move(remaining);
+    return n - indexes.size();
+}
+
+
+} // namespace DDM
+
+
+#endif
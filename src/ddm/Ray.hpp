@@ -2,14 +2,24 @@
 #define QDDM_RAY_HPP
 
 
+#include "BitArray.hpp"
+#include "DotProduct.hpp"
 #include "Gcd.hpp"
+#include "Integer.hpp"
+#include "MappedArray.hpp"
 #include "MemoryManager.hpp"
 #include "Vector.hpp"
 using Utils::ArrayMemoryManager;
+using Utils::BitArray;
+using Utils::MappedArray;
 using Utils::MemoryManager;
 using Utils::Vector;
 
+#include <algorithm>
 #include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
 
 
 namespace DDM
@@ -19,17 +29,23 @@ namespace DDM
 template <typename T, typename Set>
 class RayFactory;
 
+typedef uint32_t RayId;
+
+/* Numerical data of rays, coordinates, pivot discrepancy, visiting step and
+position in pivoting worklist, is kept by RayFactory in arrays indexed by ray
+id. */
 template <typename T, typename Set>
 struct Ray
 {
-    T* coordinates;
+    T* coordinates; // points to RayFactory storage, updated when it is moved
     Set cobasis; // set of incident inequalities
     Vector<Ray*, true> adjacentRays;
     Vector<typename Set::value_type, true> assignedInequalities; // some inequalities ray doesn't satisfy
-    T* discrepancies; // used only if plusplus in enabled
-    T pivotDiscrepancy; // discrepancy on pivot inequality
-    size_t visitingStep; // step ray has been last visited
-        
+    T* discrepancies; // cached by RayFactory for plusplus or discrepancy cache
+    // bit per inequality set if discrepancy is not positive, plusplus only
+    size_t* nonPositiveBits;
+    RayId id; // index in RayFactory arrays
+
 private:
     // The only way to create rays and delete is via RayFactory.
     friend class RayFactory<T, Set>;
@@ -45,16 +61,12 @@ private:
 
 template <typename T, typename Set>
 Ray<T, Set>::Ray(size_t numInc):
-    cobasis(numInc),
-    visitingStep(0),
-    pivotDiscrepancy(0)
+    cobasis(numInc)
 {
 }
 
 template <typename T, typename Set>
 Ray <T, Set>::Ray(Ray* plus, Ray* minus, size_t pivotIneIdx):
-    visitingStep(plus->visitingStep),
-    pivotDiscrepancy(0),
     cobasis(plus->cobasis, minus->cobasis)
 {
     cobasis.add(pivotIneIdx);
@@ -87,6 +99,16 @@ MemoryManager& Ray<T, Set>::memoryManager()
 }
 
 
+/* Creates and deletes rays. Coordinates (with cached discrepancies) of all
+rays are stored contiguously in one arena with a slot per ray id, so
+computations over many rays stream through memory. Slots of deleted rays are
+reclaimed by compact(), which keeps the order of the remaining rays. The
+arena can be spilled to a memory-mapped file, then compact() places adjacent
+rays close to each other so that pages are used by neighboring rays, while
+ray objects with cobases stay in memory. For plusplus signs of discrepancies
+are also kept as bits in a separate arena in memory. Cached discrepancies are
+combined with coordinates, so new rays get them from their plus and minus
+rays without dot products. */
 template <typename T, typename Set>
 class RayFactory
 {
@@ -95,53 +117,305 @@ public:
     typedef Ray<T, Set> Ray;
 
     RayFactory(size_t _dim, bool _intArith, size_t numDiscrepancies):
-        dim(_dim), intArith(_intArith), extendedDim(_dim + numDiscrepancies) {}
+        dim(_dim), intArith(_intArith), extendedDim(_dim + numDiscrepancies),
+        numSignWords(BitArray::numWordsFor(numDiscrepancies)),
+        numFreeSlots(0) {}
 
     Ray* newRay(const T* coords, const T* disc, size_t numInc)
     {
         Ray* ray = new Ray(numInc);
-        ray->coordinates = arrayMemoryManager.newArray(extendedDim);
-        ray->discrepancies = ray->coordinates + dim;
+        allocateSlot(ray);
         for (size_t i = 0; i < dim; ++i)
             ray->coordinates[i] = coords[i];
         for (size_t i = dim; i < extendedDim; ++i)
             ray->coordinates[i] = disc[i - dim];
-        if (intArith)
-            normalizeIntVector(ray->coordinates, extendedDim);
-        else
-            normalizeFPVector(ray->coordinates, extendedDim);
+        normalize(ray->coordinates);
+        markSigns(ray);
         return ray;
     }
 
-    Ray* newRay(Ray* plus, Ray* minus, size_t pivotIneIdx)
+    /* New ray on the pivot hyperplane between plus and minus rays. If
+    combine is false, coordinates are left for combineCoordinates(). */
+    Ray* newRay(Ray* plus, Ray* minus, size_t pivotIneIdx, bool combine = true)
     {
         Ray* ray = new Ray(plus, minus, pivotIneIdx);
-        ray->coordinates = arrayMemoryManager.newArray(extendedDim);
-        ray->discrepancies = ray->coordinates + dim;
-        for (size_t i = 0; i < extendedDim; ++i)
-            ray->coordinates[i] = plus->pivotDiscrepancy * minus->coordinates[i] -
-                minus->pivotDiscrepancy * plus->coordinates[i];
-        if (intArith)
-            normalizeIntVector(ray->coordinates, extendedDim);
-        else
-            normalizeFPVector(ray->coordinates, extendedDim);
+        allocateSlot(ray);
+        visitingSteps[ray->id] = visitingSteps[plus->id];
+        if (combine)
+            combineCoordinates(ray, plus, minus);
         return ray;
     }
 
+    /* Set coordinates of new ray, only touches its own slot, so may be
+    called for different rays in parallel once they all are created. */
+    void combineCoordinates(Ray* ray, const Ray* plus, const Ray* minus)
+    {
+        const T plusDiscrepancy = pivotDiscrepancies[plus->id];
+        const T minusDiscrepancy = pivotDiscrepancies[minus->id];
+        using Utils::mulSub;
+        for (size_t i = 0; i < extendedDim; ++i)
+            ray->coordinates[i] = mulSub(plusDiscrepancy, minus->coordinates[i],
+                minusDiscrepancy, plus->coordinates[i]);
+        normalize(ray->coordinates);
+        markSigns(ray);
+    }
+
     void deleteRay(Ray* ray)
     {
-        arrayMemoryManager.deleteArray(ray->coordinates, extendedDim);
+        slotRays[ray->id] = 0;
+        ++numFreeSlots;
         delete ray;
     }
 
+    // discrepancy on pivot inequality
+    T& pivotDiscrepancy(const Ray* ray) { return pivotDiscrepancies[ray->id]; }
+
+    /* Set pivot discrepancies of all rays to their dot products with given
+    inequality in one pass over the arena, free slots get garbage. */
+    void computePivotDiscrepancies(const T* inequality)
+    {
+        if (slotRays.size())
+            Utils::dotProductsStrided(inequality, &coordinateArena[0],
+                slotRays.size(), extendedDim, dim, &pivotDiscrepancies[0]);
+    }
+
+    // step ray has been last visited
+    size_t& visitingStep(const Ray* ray) { return visitingSteps[ray->id]; }
+    // position in pivoting worklist, noWorklistPosition if ray is not there
+    size_t& worklistPosition(const Ray* ray) { return worklistPositions[ray->id]; }
+
+    static const size_t noWorklistPosition = (size_t)-1;
+
+    /* Keep coordinates in a memory-mapped file in given directory, must be
+    called before creating rays. Return if succeeded. */
+    bool spillTo(const std::string& directory)
+    { return coordinateArena.spill(directory); }
+
+    bool compact();
+
+    /* Change the number of cached discrepancies per ray, coordinates and
+    the first discrepancies are kept, new ones are to be set by caller.
+    Not for plusplus, its sign bits are for all discrepancies. */
+    void setNumDiscrepancies(size_t numDiscrepancies);
+
 private:
     size_t dim;
     size_t extendedDim;
     bool intArith;
-    ArrayMemoryManager<T> arrayMemoryManager;
+
+    MappedArray<T> coordinateArena; // extendedDim elements per slot
+    size_t numSignWords;
+    std::vector<size_t> signArena; // numSignWords words per slot
+    std::vector<T> pivotDiscrepancies;
+    std::vector<size_t> visitingSteps;
+    std::vector<size_t> worklistPositions;
+    std::vector<Ray*> slotRays; // ray owning slot, 0 for free slots
+    size_t numFreeSlots;
+
+    void allocateSlot(Ray* ray);
+    void rebindCoordinates();
+    void orderByAdjacency();
+
+    void normalize(T* coordinates)
+    {
+        if (intArith)
+            normalizeIntVector(coordinates, extendedDim);
+        else
+            normalizeFPVector(coordinates, extendedDim);
+    }
+
+    void markSigns(Ray* ray)
+    {
+        if (!numSignWords)
+            return;
+        std::fill(ray->nonPositiveBits, ray->nonPositiveBits + numSignWords, 0);
+        for (size_t i = 0; i < extendedDim - dim; ++i)
+            if (ray->discrepancies[i] <= 0)
+                ray->nonPositiveBits[i / BitArray::wordBits] |=
+                    (size_t)1 << (i % BitArray::wordBits);
+    }
 };
 
 
+template <typename T, typename Set>
+const size_t RayFactory<T, Set>::noWorklistPosition;
+
+
+/* Give ray a new slot at the end of storage. */
+template <typename T, typename Set>
+void RayFactory<T, Set>::allocateSlot(Ray* ray)
+{
+    ray->id = (RayId)slotRays.size();
+    const T* oldArena = coordinateArena.size() ? &coordinateArena[0] : 0;
+    const size_t* oldSignArena = signArena.size() ? &signArena[0] : 0;
+    coordinateArena.resize(coordinateArena.size() + extendedDim);
+    signArena.resize(signArena.size() + numSignWords);
+    pivotDiscrepancies.push_back(0);
+    visitingSteps.push_back(0);
+    worklistPositions.push_back(noWorklistPosition);
+    slotRays.push_back(ray);
+    if ((&coordinateArena[0] != oldArena) ||
+        (numSignWords && (&signArena[0] != oldSignArena)))
+        rebindCoordinates();
+    else
+    {
+        ray->coordinates = &coordinateArena[ray->id * extendedDim];
+        ray->discrepancies = ray->coordinates + dim;
+        ray->nonPositiveBits = numSignWords ?
+            &signArena[ray->id * numSignWords] : 0;
+    }
+}
+
+
+/* Update coordinate and sign pointers of all rays after storage has moved. */
+template <typename T, typename Set>
+void RayFactory<T, Set>::rebindCoordinates()
+{
+    for (size_t i = 0; i < slotRays.size(); ++i)
+        if (slotRays[i])
+        {
+            slotRays[i]->coordinates = &coordinateArena[i * extendedDim];
+            slotRays[i]->discrepancies = slotRays[i]->coordinates + dim;
+            slotRays[i]->nonPositiveBits = numSignWords ?
+                &signArena[i * numSignWords] : 0;
+        }
+}
+
+
+template <typename T, typename Set>
+void RayFactory<T, Set>::setNumDiscrepancies(size_t numDiscrepancies)
+{
+    const size_t newExtendedDim = dim + numDiscrepancies;
+    if (newExtendedDim == extendedDim)
+        return;
+    // slots are moved in place, to the front when shrinking and from the back
+    // when growing, so that no slot is overwritten before it is moved
+    const size_t numKept = std::min(extendedDim, newExtendedDim);
+    const size_t numSlots = slotRays.size();
+    if (newExtendedDim < extendedDim)
+    {
+        for (size_t i = 1; i < numSlots; ++i)
+            std::copy(coordinateArena.begin() + i * extendedDim,
+                coordinateArena.begin() + i * extendedDim + numKept,
+                coordinateArena.begin() + i * newExtendedDim);
+        coordinateArena.resize(numSlots * newExtendedDim);
+    }
+    else
+    {
+        coordinateArena.resize(numSlots * newExtendedDim);
+        for (size_t i = numSlots; i-- > 1; )
+            std::copy_backward(coordinateArena.begin() + i * extendedDim,
+                coordinateArena.begin() + i * extendedDim + numKept,
+                coordinateArena.begin() + i * newExtendedDim + numKept);
+    }
+    extendedDim = newExtendedDim;
+    rebindCoordinates();
+}
+
+
+/* Move rays to fill slots of deleted ones, keeping their order or, for
+spilled arena, ordering them by adjacency. Is done only when at least half of
+the slots are free, so amortized cost is constant per deleted ray. Ray ids
+and coordinate pointers change, return if it is done. */
+template <typename T, typename Set>
+bool RayFactory<T, Set>::compact()
+{
+    if (2 * numFreeSlots < slotRays.size())
+        return false;
+    if (coordinateArena.isSpilled())
+        orderByAdjacency();
+    size_t numRays = 0;
+    for (size_t i = 0; i < slotRays.size(); ++i)
+        if (slotRays[i])
+        {
+            if (numRays != i)
+            {
+                std::copy(coordinateArena.begin() + i * extendedDim,
+                    coordinateArena.begin() + (i + 1) * extendedDim,
+                    coordinateArena.begin() + numRays * extendedDim);
+                std::copy(signArena.begin() + i * numSignWords,
+                    signArena.begin() + (i + 1) * numSignWords,
+                    signArena.begin() + numRays * numSignWords);
+                pivotDiscrepancies[numRays] = pivotDiscrepancies[i];
+                visitingSteps[numRays] = visitingSteps[i];
+                worklistPositions[numRays] = worklistPositions[i];
+                slotRays[numRays] = slotRays[i];
+                slotRays[numRays]->id = (RayId)numRays;
+            }
+            ++numRays;
+        }
+    coordinateArena.resize(numRays * extendedDim);
+    signArena.resize(numRays * numSignWords);
+    pivotDiscrepancies.resize(numRays);
+    visitingSteps.resize(numRays);
+    worklistPositions.resize(numRays);
+    slotRays.resize(numRays);
+    numFreeSlots = 0;
+    rebindCoordinates();
+    return true;
+}
+
+
+/* Permute slots in place so that rays go in breadth-first order of
+adjacency graph followed by free slots. Rays are checked against slots before
+following their edges. */
+template <typename T, typename Set>
+void RayFactory<T, Set>::orderByAdjacency()
+{
+    const size_t numSlots = slotRays.size();
+    std::vector<size_t> newSlots(numSlots, numSlots);
+    std::vector<size_t> queue;
+    queue.reserve(numSlots);
+    size_t numOrdered = 0;
+    for (size_t start = 0; start < numSlots; ++start)
+    {
+        if (!slotRays[start] || (newSlots[start] != numSlots))
+            continue;
+        newSlots[start] = numOrdered++;
+        queue.push_back(start);
+        for (size_t q = queue.size() - 1; q < queue.size(); ++q)
+        {
+            const Ray* ray = slotRays[queue[q]];
+            for (size_t i = 0; i < ray->adjacentRays.size(); ++i)
+            {
+                const Ray* adjRay = ray->adjacentRays[i];
+                size_t slot = adjRay->id;
+                if ((slot < numSlots) && (slotRays[slot] == adjRay) &&
+                    (newSlots[slot] == numSlots))
+                {
+                    newSlots[slot] = numOrdered++;
+                    queue.push_back(slot);
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < numSlots; ++i)
+        if (newSlots[i] == numSlots)
+            newSlots[i] = numOrdered++;
+
+    // apply permutation by swaps, each puts one slot to its place
+    for (size_t i = 0; i < numSlots; ++i)
+        while (newSlots[i] != i)
+        {
+            size_t j = newSlots[i];
+            std::swap_ranges(coordinateArena.begin() + i * extendedDim,
+                coordinateArena.begin() + (i + 1) * extendedDim,
+                coordinateArena.begin() + j * extendedDim);
+            std::swap_ranges(signArena.begin() + i * numSignWords,
+                signArena.begin() + (i + 1) * numSignWords,
+                signArena.begin() + j * numSignWords);
+            std::swap(pivotDiscrepancies[i], pivotDiscrepancies[j]);
+            std::swap(visitingSteps[i], visitingSteps[j]);
+            std::swap(worklistPositions[i], worklistPositions[j]);
+            std::swap(slotRays[i], slotRays[j]);
+            std::swap(newSlots[i], newSlots[j]);
+        }
+    for (size_t i = 0; i < numSlots; ++i)
+        if (slotRays[i])
+            slotRays[i]->id = (RayId)i;
+}
+
+
 } // namespace DDM
 
 
@@ -0,0 +1,152 @@
+#ifndef QDDM_SIGN_FILTER_HPP
+#define QDDM_SIGN_FILTER_HPP
+
+
+#include "GaussianElimination.hpp"
+#include "Integer.hpp"
+#include "Matrix.hpp"
+#include "Vector.hpp"
+using Utils::Integer;
+using Utils::Matrix;
+using Utils::Vector;
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+
+namespace DDM
+{
+
+
+/* Exact integer vector proportional to a floating-point one, doubles are
+dyadic rationals so they are scaled by a common power of 2. */
+template <typename T>
+void toExactVector(const T* vector, size_t size, Integer* result)
+{
+    std::vector<long long> mantissas(size);
+    std::vector<int> exponents(size);
+    int minExponent = std::numeric_limits<int>::max();
+    for (size_t i = 0; i < size; ++i)
+    {
+        int exponent;
+        double fraction = std::frexp((double)vector[i], &exponent);
+        mantissas[i] = (long long)std::ldexp(fraction, 53);
+        exponents[i] = exponent - 53;
+        if (mantissas[i] && (exponents[i] < minExponent))
+            minExponent = exponents[i];
+    }
+    for (size_t i = 0; i < size; ++i)
+    {
+        result[i] = mantissas[i];
+        for (int k = minExponent; mantissas[i] && (k < exponents[i]); ++k)
+            result[i] *= 2;
+    }
+}
+
+inline void toExactVector(const Integer* vector, size_t size, Integer* result)
+{
+    for (size_t i = 0; i < size; ++i)
+        result[i] = vector[i];
+}
+
+
+/* Floating-point filter for signs of discrepancies. A discrepancy is decided
+in floating point if it is outside a band around zero made of the forward
+error bound of the dot product and zerotol, both scaled by 1-norm of the
+inequality (rays are normalized to max absolute coordinate 1). Inside the band
+exact sign is computed from the cobasis of the ray: its null space over exact
+inequalities is the ray direction, it is computed once per ray. */
+template <typename T>
+class SignFilter
+{
+public:
+
+    enum {Unknown = 2};
+
+    SignFilter(const Matrix<T>& inequalities, const T& zerotol):
+        dim(inequalities.ncols()),
+        exactInequalities(inequalities.nrows(), inequalities.ncols()),
+        uncertainty(inequalities.nrows())
+    {
+        const double unitRoundoff =
+            (double)std::numeric_limits<T>::epsilon() / 2;
+        const double errorBound = dim * unitRoundoff / (1 - dim * unitRoundoff);
+        for (size_t i = 0; i < inequalities.nrows(); ++i)
+        {
+            toExactVector(inequalities.row(i), dim, exactInequalities.row(i));
+            double norm = 0;
+            for (size_t j = 0; j < dim; ++j)
+                norm += std::fabs((double)inequalities(i, j));
+            uncertainty[i] = (T)(norm * (errorBound + (double)zerotol));
+        }
+    }
+
+    bool isCertain(const T& disc, size_t inequalityIdx) const
+    {
+        return (disc > uncertainty[inequalityIdx]) ||
+            (disc < -uncertainty[inequalityIdx]);
+    }
+
+    /* Exact sign of discrepancy of ray with given id, cobasis and approximate
+    coordinates, Unknown if cobasis doesn't define a single direction.
+    Directions are cached by ray ids until clearCache(). */
+    template <typename Set>
+    int exactSign(const Set& cobasis, const T* coordinates, size_t rayId,
+        size_t inequalityIdx)
+    {
+        if (rayId >= directions.size())
+            directions.resize(rayId + 1);
+        std::vector<Integer>& direction = directions[rayId];
+        if (direction.empty() && !computeDirection(cobasis, coordinates,
+            direction))
+            return Unknown;
+        Integer disc = 0;
+        for (size_t j = 0; j < dim; ++j)
+            disc += direction[j] * exactInequalities(inequalityIdx, j);
+        return (disc > 0) ? 1 : ((disc < 0) ? -1 : 0);
+    }
+
+    // must be called when ray ids change
+    void clearCache() { directions.clear(); }
+
+private:
+
+    size_t dim;
+    Matrix<Integer> exactInequalities;
+    std::vector<T> uncertainty;
+    std::vector<std::vector<Integer> > directions; // empty if not computed
+
+    /* Exact direction of ray as null space of its cobasis, oriented as
+    approximate coordinates. Return if it is unique. */
+    template <typename Set>
+    bool computeDirection(const Set& cobasis, const T* coordinates,
+        std::vector<Integer>& direction) const
+    {
+        Vector<size_t> rows = cobasis.toVector();
+        std::vector<Integer> a(rows.size() * dim);
+        for (size_t i = 0; i < rows.size(); ++i)
+            for (size_t j = 0; j < dim; ++j)
+                a[i * dim + j] = exactInequalities(rows[i], j);
+        direction.resize(dim);
+        if (!rows.size() ||
+            !integerNullVector(&a[0], rows.size(), dim, &direction[0]))
+        {
+            direction.clear();
+            return false;
+        }
+        double orientation = 0;
+        for (size_t j = 0; j < dim; ++j)
+            orientation += (double)direction[j] * (double)coordinates[j];
+        if (orientation < 0)
+            for (size_t j = 0; j < dim; ++j)
+                direction[j] = -direction[j];
+        return true;
+    }
+};
+
+
+} // namespace DDM
+
+
+#endif
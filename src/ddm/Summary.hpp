@@ -20,6 +20,7 @@ public:
 
     Summary():
         adjacencyTestingTime(0.0),
+        checkpointingTime(0.0),
         classifyingRaysTime(0.0),
         computationalTime(0.0),
         computingBasisTime(0.0),
@@ -30,15 +31,19 @@ public:
         numExtremeRays(0),
         numFacets(0),
         numIterations(0),
+        numRemovedInequalities(0),
         totalNumAdjacencyTests(0),
         totalNumDotproducts(0),
         totalNumEdges(0), 
+        totalNumExactSigns(0),
         totalNumPotentialAdjacencyTests(0),
         totalNumRays(0)
     {}
 
     void startAdjacencyTesting() { adjacencyTestingTime -= getTimeSec(); }
     void endAdjacencyTesting() { adjacencyTestingTime += getTimeSec(); }
+    void startCheckpointing() { checkpointingTime -= getTimeSec(); }
+    void endCheckpointing() { checkpointingTime += getTimeSec(); }
     void startClassifyingRays() { classifyingRaysTime -= getTimeSec(); }
     void endClassifyingRays() { classifyingRaysTime += getTimeSec(); }
     void startComputations() { computationalTime -= getTimeSec(); }
@@ -58,11 +63,14 @@ public:
     void addAdjacencyTests(size_t n) { totalNumAdjacencyTests += n; }
     void addEdges(size_t n) { totalNumEdges += n; }
     void addDotproduct() { totalNumDotproducts++; }
+    void addExactSign() { totalNumExactSigns++; }
 
     void setNumExtremeRays(size_t value) { numExtremeRays = value; }
     void setNumEdges(size_t value) { numEdges = value; }
     void setNumFacets(size_t value) { numFacets = value; }
     void setNumIterations(size_t value) { numIterations = value; }
+    void setNumRemovedInequalities(size_t value)
+    { numRemovedInequalities = value; }
 
     friend std::ostream& operator <<(std::ostream & os, const Summary & summary)
     {
@@ -76,6 +84,7 @@ public:
     timers.push_back(make_pair(summary.potentialAdjacencyTestingTime, "potential adjacency testing"));
     timers.push_back(make_pair(summary.adjacencyTestingTime, "adjacency testing"));
     timers.push_back(make_pair(summary.partitioningTime, "partitioning"));
+    timers.push_back(make_pair(summary.checkpointingTime, "checkpointing"));
     double othersTime = totalTime;
     for (size_t i = 0; i < timers.size(); i++)
     {
@@ -86,12 +95,15 @@ public:
     os << "    other: " << othersTime << " sec (" << 100.0 * othersTime
         / totalTime << "%)\n";
 
+    os << "Inequalities removed by presolve: "
+        << summary.numRemovedInequalities << "\n";
     os << "Total rays created: " << summary.totalNumRays << "\n";
     os << "Potential adjacency tests performed: "
         << summary.totalNumPotentialAdjacencyTests << "\n";
     os << "Adjacency tests performed: " << summary.totalNumAdjacencyTests << "\n";
     os << "Total edges created: " << summary.totalNumEdges << "\n";
     os << "Dot products computed: " << summary.totalNumDotproducts << "\n";
+    os << "Exact signs computed: " << summary.totalNumExactSigns << "\n";
 
     os << "Number of extreme rays: " << summary.numExtremeRays << "\n";
     os << "Number of edges: " << summary.numEdges << "\n";
@@ -102,12 +114,13 @@ public:
 
 private:
 
-    double adjacencyTestingTime, classifyingRaysTime,
+    double adjacencyTestingTime, checkpointingTime, classifyingRaysTime,
         computationalTime, computingBasisTime, partitioningTime,
         potentialAdjacencyTestingTime, selectingPivotTime;
-    size_t numEdges, numExtremeRays, numFacets, numIterations;
+    size_t numEdges, numExtremeRays, numFacets, numIterations,
+        numRemovedInequalities;
     size_t totalNumAdjacencyTests, totalNumDotproducts, totalNumEdges, 
-        totalNumPotentialAdjacencyTests, totalNumRays;
+        totalNumExactSigns, totalNumPotentialAdjacencyTests, totalNumRays;
 
 };
 
@@ -1,4 +1,5 @@
 #include "Algorithm.hpp"
+using Utils::Integer;
 using Utils::Matrix;
 using namespace DDM;
 
@@ -9,6 +10,7 @@ using namespace UIUtils;
 #include "tclap/CmdLine.h"
 #include "tclap/ValuesConstraint.h"
 
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -42,10 +44,10 @@ bool check(const Matrix<T>& inequalities,
     Parameters& params, bool intArithmetic, const T& zerotol);
 
 /* Process task: read input, run qkeleton, write output, and check result if
-necessary. */
+necessary. Rational input is read exactly and scaled to integers by rows. */
 template <typename T>
 void processTask(Parameters& params, IOParams& ioParams, bool intArithmetic,
-    const T& zerotol, bool checkResult);
+    bool rationalInput, const T& zerotol, bool checkResult);
 
 
 int main(int argc, char *argv[])
@@ -61,11 +63,13 @@ int main(int argc, char *argv[])
 
     // Process task using chosen arithmetic.
     if (args.arithmetic == Arithmetic::Int)
-        processTask<int>(args.parameters, args.ioParams, true, 0, args.checkResult);
+        processTask<Integer>(args.parameters, args.ioParams, true, false, 0, args.checkResult);
+    else if (args.arithmetic == Arithmetic::Rational)
+        processTask<Integer>(args.parameters, args.ioParams, true, true, 0, args.checkResult);
     else if (args.arithmetic == Arithmetic::Double)
-        processTask<double>(args.parameters, args.ioParams, false, args.zerotol, args.checkResult);
+        processTask<double>(args.parameters, args.ioParams, false, false, args.zerotol, args.checkResult);
     else if (args.arithmetic == Arithmetic::Float)
-        processTask<float>(args.parameters, args.ioParams, false, (float)args.zerotol, args.checkResult);
+        processTask<float>(args.parameters, args.ioParams, false, false, (float)args.zerotol, args.checkResult);
 
     return 0;
 }
@@ -124,6 +128,47 @@ void parseCommandLine(int argc, char *argv[], CommandLineArgs * args,
             "Enable plusplus for edge elimination.",
             cmd, false);
 
+        SwitchArg furthestFlag("", "furthest",
+            "Assign each inequality to the ray violating it most instead of "
+            "the first one, keeps quickhull order close to its idea.",
+            cmd, false);
+
+        ValueArg<size_t> discrepancyCache("", "disccache",
+            "Keep discrepancies of rays on inequalities not added yet in given "
+            "megabytes of memory: all of them if they fit, otherwise for static "
+            "orders on the next inequalities. Not used with plusplus, which "
+            "keeps all of them, and exactsigns, default = 0.", false, 0,
+            "megabytes", cmd);
+
+        ValueArg<size_t> numThreads("", "threads",
+            "Number of threads for computing adjacency and classifying rays, "
+            "requires build with OpenMP, default = 1.", false, 1, "number", cmd);
+
+        SwitchArg exactSignsFlag("", "exactsigns",
+            "Compute signs of discrepancies close to zero exactly, for "
+            "floating-point arithmetic.", cmd, false);
+
+        SwitchArg noPresolveFlag("", "nopresolve",
+            "Keep zero and duplicate inequalities, by default they are "
+            "removed before computations.", cmd, false);
+
+        ValueArg<string> checkpointFile("", "checkpoint",
+            "Write state of computations to file periodically.", false, "",
+            "filename", cmd);
+
+        ValueArg<string> checkpointEvery("", "checkpoint-every",
+            "Period of writing checkpoints, number of iterations or number of "
+            "seconds with suffix s, default = 600s.", false, "600s", "period",
+            cmd);
+
+        SwitchArg resumeFlag("", "resume",
+            "Resume computations from checkpoint file.", cmd, false);
+
+        ValueArg<string> spillDirectory("", "spill",
+            "Keep ray coordinates in a memory-mapped file in given directory "
+            "to process more rays than fit in memory, requires build with "
+            "mmap.", false, "", "directory", cmd);
+
         SwitchArg checkResultFlag("", "check",
             "Check result after computation. Warning: it could take "
             "much more time and/or memory than computation itself,"
@@ -152,6 +197,44 @@ void parseCommandLine(int argc, char *argv[], CommandLineArgs * args,
         args->parameters.adjacencyTest = adjacencyTest.getValue();
         args->parameters.setRepresentation = setRepresentation.getValue();
         args->parameters.usePlusPlus = plusplusFlag.getValue();
+        args->parameters.furthestAssignment = furthestFlag.getValue();
+        args->parameters.discrepancyCacheMegabytes = discrepancyCache.getValue();
+        args->parameters.numThreads = numThreads.getValue();
+        args->parameters.exactSigns = exactSignsFlag.getValue();
+        args->parameters.presolve = !noPresolveFlag.getValue();
+#ifndef USE_OPENMP
+        if (args->parameters.numThreads > 1)
+        {
+            std::cerr << "WARNING: built without OpenMP, --"
+                << numThreads.getName() << " is ignored.\n";
+            args->parameters.numThreads = 1;
+        }
+#endif
+        if (!args->parameters.numThreads)
+            args->parameters.numThreads = 1;
+        args->parameters.checkpointFile = checkpointFile.getValue();
+        args->parameters.resume = resumeFlag.getValue();
+        if (args->parameters.resume && args->parameters.checkpointFile.empty())
+            throw CmdLineParseException("requires --" +
+                checkpointFile.getName(), resumeFlag.longID());
+        const string& period = checkpointEvery.getValue();
+        char* periodEnd = 0;
+        unsigned long periodValue = strtoul(period.c_str(), &periodEnd, 10);
+        if ((periodEnd == period.c_str()) || !periodValue ||
+            (*periodEnd && std::string(periodEnd) != "s"))
+            throw CmdLineParseException("must be a positive number of "
+                "iterations or seconds with suffix s", checkpointEvery.longID());
+        args->parameters.checkpointIterations = *periodEnd ? 0 : periodValue;
+        args->parameters.checkpointSeconds = periodValue;
+        args->parameters.spillDirectory = spillDirectory.getValue();
+#ifndef USE_MMAP
+        if (!args->parameters.spillDirectory.empty())
+        {
+            std::cerr << "WARNING: built without mmap, --"
+                << spillDirectory.getName() << " is ignored.\n";
+            args->parameters.spillDirectory.clear();
+        }
+#endif
         args->checkResult = checkResultFlag.getValue();
     }
     catch (ArgException & e)
@@ -178,11 +261,13 @@ void parseCommandLine(int argc, char *argv[], CommandLineArgs * args,
 
 template <typename T>
 void processTask(Parameters& params, IOParams& ioParams, bool intArithmetic,
-    const T& zerotol, bool checkResult)
+    bool rationalInput, const T& zerotol, bool checkResult)
 {
     // Read input matrix.
     Matrix<T> inequalities;
-    bool succeed = readMatrix(ioParams.inputStream.get(), inequalities);
+    bool succeed = rationalInput ?
+        readRationalMatrix(ioParams.inputStream.get(), inequalities) :
+        readMatrix(ioParams.inputStream.get(), inequalities);
     if (!succeed)
         return;
 
@@ -193,8 +278,13 @@ void processTask(Parameters& params, IOParams& ioParams, bool intArithmetic,
     srand((unsigned int)beginTime);
     Matrix<T> extremeRays;
     std::vector<size_t> facets;
-    ddm(inequalities, params, intArithmetic, zerotol, extremeRays, facets);
-    writeMatrix(ioParams.outputStream.get(), extremeRays);
+    // Without check the result matrix is not needed, rays are streamed.
+    if (!checkResult)
+        params.outputStream = &ioParams.outputStream.get();
+    if (!ddm(inequalities, params, intArithmetic, zerotol, extremeRays, facets))
+        return;
+    if (checkResult)
+        writeMatrix(ioParams.outputStream.get(), extremeRays);
     time_t endTime;
     time(&endTime);
     std::cout << "\nComputation finished: " << asctime(localtime(&endTime));
@@ -207,6 +297,8 @@ void processTask(Parameters& params, IOParams& ioParams, bool intArithmetic,
         params.logStream = &ioParams.logStream.get();
         ioParams.summaryStream.setNull();
         params.summaryStream = &ioParams.summaryStream.get();
+        params.checkpointFile.clear();
+        params.resume = false;
         bool resultCorrect = check(inequalities, extremeRays, facets, params,
             intArithmetic, zerotol);
         if (resultCorrect)
@@ -52,6 +52,37 @@ void elimination(const Matrix<T>& inequalities,
         alg.run(inequalities, eliminationVariables, parameters, result);
         return;
     }
+    // For larger inputs sizes grow twice to limit number of instances.
+    if (inequalities.nrows() <= 256)
+    {
+        EliminationAlgorithm<T, Utils::BitFieldSet<256> > alg;
+        alg.run(inequalities, eliminationVariables, parameters, result);
+        return;
+    }
+    if (inequalities.nrows() <= 512)
+    {
+        EliminationAlgorithm<T, Utils::BitFieldSet<512> > alg;
+        alg.run(inequalities, eliminationVariables, parameters, result);
+        return;
+    }
+    if (inequalities.nrows() <= 1024)
+    {
+        EliminationAlgorithm<T, Utils::BitFieldSet<1024> > alg;
+        alg.run(inequalities, eliminationVariables, parameters, result);
+        return;
+    }
+    if (inequalities.nrows() <= 2048)
+    {
+        EliminationAlgorithm<T, Utils::BitFieldSet<2048> > alg;
+        alg.run(inequalities, eliminationVariables, parameters, result);
+        return;
+    }
+    if (inequalities.nrows() <= 4096)
+    {
+        EliminationAlgorithm<T, Utils::BitFieldSet<4096> > alg;
+        alg.run(inequalities, eliminationVariables, parameters, result);
+        return;
+    }
 
     // If impossible to find appropriate bitfield, use vector-based sets.
     EliminationAlgorithm<T, Utils::VectorSet<size_t> > alg;
@@ -2,6 +2,7 @@
 #define ELIMINATION_INEQUALITY_HPP
 
 
+#include "Integer.hpp"
 #include "MemoryManager.hpp"
 using namespace Utils;
 
@@ -84,10 +85,11 @@ public:
     {
         Inequality* inequality = new Inequality(plus, minus);
         inequality->normal = arrayMemoryManager.newArray(dim);
+        using Utils::mulSub;
         for (size_t i = 0; i < dim; ++i)
             inequality->normal[i] =
-                plus->normal[eliminated] * minus->normal[i]
-               - minus->normal[eliminated] * plus->normal[i];
+                mulSub(plus->normal[eliminated], minus->normal[i],
+                    minus->normal[eliminated], plus->normal[i]);
         if (intArith)
             normalizeIntVector(inequality->normal, dim);
         else
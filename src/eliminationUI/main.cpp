@@ -1,5 +1,6 @@
 #include "Elimination.hpp"
 #include "GaussianElimination.hpp"
+using Utils::Integer;
 using Utils::Matrix;
 using namespace Elimination;
 
@@ -64,10 +65,11 @@ int main(int argc, char *argv[])
 
     // Process task using chosen arithmetic.
     args.parameters.zerotol = 1e-6;
-    if (args.arithmetic == Arithmetic::Int)
+    if ((args.arithmetic == Arithmetic::Int) ||
+        (args.arithmetic == Arithmetic::Rational))
     {
         args.parameters.zerotol = 0;
-        processTask<int>(args);
+        processTask<Integer>(args);
     }
     else if (args.arithmetic == Arithmetic::Double)
         processTask<double>(args);
@@ -222,7 +224,9 @@ template <typename T>
 void processTask(const CommandLineArgs& args)
 {
     Matrix<T> inequalities;
-    bool succeed = readMatrix(args.ioParams.inputStream.get(), inequalities);
+    bool succeed = (args.arithmetic == Arithmetic::Rational) ?
+        readRationalMatrix(args.ioParams.inputStream.get(), inequalities) :
+        readMatrix(args.ioParams.inputStream.get(), inequalities);
     if (!succeed)
         return;
     size_t dim = inequalities.ncols();
@@ -0,0 +1,71 @@
+#ifndef UTILS_BINARY_IO_HPP
+#define UTILS_BINARY_IO_HPP
+
+
+#include <cstddef>
+#include <iostream>
+#include <stdint.h>
+
+
+namespace Utils
+{
+
+
+/* Raw binary writing and reading of values and arrays of plain types, in the
+byte order of the machine. Types with dynamic storage provide overloads.
+Readers return if the stream is still good. */
+
+
+template <typename T>
+inline void writeBinary(std::ostream& os, const T& value)
+{
+    os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+inline bool readBinary(std::istream& is, T& value)
+{
+    return (bool)is.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+template <typename T>
+inline void writeBinary(std::ostream& os, const T* values, size_t n)
+{
+    os.write(reinterpret_cast<const char*>(values), n * sizeof(T));
+}
+
+template <typename T>
+inline bool readBinary(std::istream& is, T* values, size_t n)
+{
+    return (bool)is.read(reinterpret_cast<char*>(values), n * sizeof(T));
+}
+
+
+/* Matrix is written as 64-bit numbers of rows and columns followed by rows. */
+template <typename MatrixType>
+void writeBinaryMatrix(std::ostream& os, const MatrixType& m)
+{
+    writeBinary(os, (uint64_t)m.nrows());
+    writeBinary(os, (uint64_t)m.ncols());
+    for (size_t i = 0; i < m.nrows(); ++i)
+        writeBinary(os, m.row(i), m.ncols());
+}
+
+template <typename MatrixType>
+bool readBinaryMatrix(std::istream& is, MatrixType& m)
+{
+    uint64_t nrows, ncols;
+    if (!readBinary(is, nrows) || !readBinary(is, ncols))
+        return false;
+    m.resize((size_t)nrows, (size_t)ncols);
+    for (size_t i = 0; i < m.nrows(); ++i)
+        if (!readBinary(is, m.row(i), m.ncols()))
+            return false;
+    return true;
+}
+
+
+} // namespace Utils
+
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef UTILS_BIT_ARRAY_HPP
+#define UTILS_BIT_ARRAY_HPP
+
+
+#include "BitCount.hpp"
+
+#include <cstddef>
+#include <vector>
+
+
+namespace Utils
+{
+
+
+/* Array of bits of size given at runtime, stored in words so that it can be
+combined with other bit arrays of the same size word by word. */
+class BitArray
+{
+public:
+
+    static const size_t wordBits = 8 * sizeof(size_t);
+
+    BitArray(): numBits(0) {}
+
+    static size_t numWordsFor(size_t n) { return (n + wordBits - 1) / wordBits; }
+
+    void assign(size_t n, bool value)
+    {
+        numBits = n;
+        bits.assign(numWordsFor(n), value ? ~(size_t)0 : 0);
+        if (value && (n % wordBits))
+            bits.back() = ((size_t)1 << (n % wordBits)) - 1;
+    }
+
+    size_t size() const { return numBits; }
+    size_t numWords() const { return bits.size(); }
+    const size_t* words() const { return bits.empty() ? 0 : &bits[0]; }
+
+    bool test(size_t i) const
+    { return (bits[i / wordBits] >> (i % wordBits)) & 1; }
+
+    void set(size_t i) { bits[i / wordBits] |= (size_t)1 << (i % wordBits); }
+    void reset(size_t i) { bits[i / wordBits] &= ~((size_t)1 << (i % wordBits)); }
+
+    size_t count() const { return bits.empty() ? 0 : popcountWords(&bits[0], bits.size()); }
+
+    /* Index of the first set bit not less than i, size() if there is none. */
+    size_t findNext(size_t i) const
+    {
+        if (i >= numBits)
+            return numBits;
+        size_t w = i / wordBits;
+        size_t word = bits[w] & (~(size_t)0 << (i % wordBits));
+        while (!word)
+        {
+            if (++w == bits.size())
+                return numBits;
+            word = bits[w];
+        }
+        // number of trailing zeros
+        return w * wordBits + popcount((word & (0 - word)) - 1);
+    }
+
+    size_t findFirst() const { return findNext(0); }
+
+    /* Whether some bit is set both here and in array of numWords() words. */
+    bool intersects(const size_t* words) const
+    {
+        for (size_t w = 0; w < bits.size(); ++w)
+            if (bits[w] & words[w])
+                return true;
+        return false;
+    }
+
+private:
+
+    size_t numBits;
+    std::vector<size_t> bits;
+};
+
+
+} // namespace Utils
+
+
+#endif
@@ -0,0 +1,323 @@
+#ifndef UTILS_BIT_COUNT_HPP
+#define UTILS_BIT_COUNT_HPP
+
+
+#include <cstddef>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Vectorized kernels need GCC-compatible target attributes, CPU detection
+// and 64-bit words.
+#if defined(USE_SIMD) && defined(__GNUC__) && defined(__x86_64__)
+#define UTILS_X86_BIT_COUNT
+#include <immintrin.h>
+#endif
+
+
+namespace Utils
+{
+
+
+/* Number of set bits in a word, uses processor instruction if available. */
+inline size_t popcount(size_t word)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return __popcnt64(word);
+#else
+    unsigned long long b = word;
+    b = b - ((b >> 1) & 0x5555555555555555ULL);
+    b = (b & 0x3333333333333333ULL) + ((b >> 2) & 0x3333333333333333ULL);
+    b = (b + (b >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (size_t)((b * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+
+/* Operations on arrays of n words used by bit field sets: number of set bits,
+number of bits set in both a and b, whether bits of a are subset of bits of b.
+Kernels for POPCNT, AVX2 and AVX-512 VPOPCNTDQ are chosen at runtime. */
+
+
+inline size_t popcountWordsScalar(const size_t* a, size_t n)
+{
+    size_t result = 0;
+    for (size_t i = 0; i < n; ++i)
+        result += popcount(a[i]);
+    return result;
+}
+
+inline size_t andPopcountWordsScalar(const size_t* a, const size_t* b, size_t n)
+{
+    size_t result = 0;
+    for (size_t i = 0; i < n; ++i)
+        result += popcount(a[i] & b[i]);
+    return result;
+}
+
+inline bool isSubsetWordsScalar(const size_t* a, const size_t* b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (a[i] & ~b[i])
+            return false;
+    return true;
+}
+
+
+#ifdef UTILS_X86_BIT_COUNT
+
+__attribute__((target("popcnt")))
+inline size_t popcountWordsPopcnt(const size_t* a, size_t n)
+{
+    size_t result = 0;
+    for (size_t i = 0; i < n; ++i)
+        result += __builtin_popcountll(a[i]);
+    return result;
+}
+
+__attribute__((target("popcnt")))
+inline size_t andPopcountWordsPopcnt(const size_t* a, const size_t* b, size_t n)
+{
+    size_t result = 0;
+    for (size_t i = 0; i < n; ++i)
+        result += __builtin_popcountll(a[i] & b[i]);
+    return result;
+}
+
+
+// Number of set bits in each 64-bit lane, via nibble lookup table.
+__attribute__((target("avx2")))
+inline __m256i popcount256(__m256i v)
+{
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0f);
+    __m256i low = _mm256_and_si256(v, lowMask);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+    __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low),
+        _mm256_shuffle_epi8(lookup, high));
+    return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+// Carry-save adder: h:l = a + b + c bitwise.
+__attribute__((target("avx2")))
+inline void carrySaveAdd(__m256i& h, __m256i& l, __m256i a, __m256i b, __m256i c)
+{
+    __m256i u = _mm256_xor_si256(a, b);
+    h = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+    l = _mm256_xor_si256(u, c);
+}
+
+// Load i-th 256-bit vector of a, or of (a & b) if b is not null.
+__attribute__((target("avx2")))
+inline __m256i loadWords256(const size_t* a, const size_t* b, size_t i)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i*)(a + 4 * i));
+    if (b)
+        v = _mm256_and_si256(v, _mm256_loadu_si256((const __m256i*)(b + 4 * i)));
+    return v;
+}
+
+/* Harley-Seal popcount: blocks of 16 vectors are reduced with carry-save
+adders so that only one vector popcount per block is needed. */
+__attribute__((target("avx2,popcnt")))
+inline size_t popcountWordsAvx2Impl(const size_t* a, const size_t* b, size_t n)
+{
+    const size_t numVectors = n / 4;
+    __m256i total = _mm256_setzero_si256();
+    __m256i ones = _mm256_setzero_si256(), twos = _mm256_setzero_si256(),
+        fours = _mm256_setzero_si256(), eights = _mm256_setzero_si256(),
+        sixteens;
+    __m256i twosA, twosB, foursA, foursB, eightsA, eightsB;
+    size_t i = 0;
+    for (; i + 16 <= numVectors; i += 16)
+    {
+        carrySaveAdd(twosA, ones, ones, loadWords256(a, b, i), loadWords256(a, b, i + 1));
+        carrySaveAdd(twosB, ones, ones, loadWords256(a, b, i + 2), loadWords256(a, b, i + 3));
+        carrySaveAdd(foursA, twos, twos, twosA, twosB);
+        carrySaveAdd(twosA, ones, ones, loadWords256(a, b, i + 4), loadWords256(a, b, i + 5));
+        carrySaveAdd(twosB, ones, ones, loadWords256(a, b, i + 6), loadWords256(a, b, i + 7));
+        carrySaveAdd(foursB, twos, twos, twosA, twosB);
+        carrySaveAdd(eightsA, fours, fours, foursA, foursB);
+        carrySaveAdd(twosA, ones, ones, loadWords256(a, b, i + 8), loadWords256(a, b, i + 9));
+        carrySaveAdd(twosB, ones, ones, loadWords256(a, b, i + 10), loadWords256(a, b, i + 11));
+        carrySaveAdd(foursA, twos, twos, twosA, twosB);
+        carrySaveAdd(twosA, ones, ones, loadWords256(a, b, i + 12), loadWords256(a, b, i + 13));
+        carrySaveAdd(twosB, ones, ones, loadWords256(a, b, i + 14), loadWords256(a, b, i + 15));
+        carrySaveAdd(foursB, twos, twos, twosA, twosB);
+        carrySaveAdd(eightsB, fours, fours, foursA, foursB);
+        carrySaveAdd(sixteens, eights, eights, eightsA, eightsB);
+        total = _mm256_add_epi64(total, popcount256(sixteens));
+    }
+    total = _mm256_slli_epi64(total, 4);
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount256(eights), 3));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount256(fours), 2));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount256(twos), 1));
+    total = _mm256_add_epi64(total, popcount256(ones));
+    for (; i < numVectors; ++i)
+        total = _mm256_add_epi64(total, popcount256(loadWords256(a, b, i)));
+
+    size_t result = (size_t)_mm256_extract_epi64(total, 0) +
+        (size_t)_mm256_extract_epi64(total, 1) +
+        (size_t)_mm256_extract_epi64(total, 2) +
+        (size_t)_mm256_extract_epi64(total, 3);
+    for (i = 4 * numVectors; i < n; ++i)
+        result += __builtin_popcountll(b ? a[i] & b[i] : a[i]);
+    return result;
+}
+
+__attribute__((target("avx2,popcnt")))
+inline size_t popcountWordsAvx2(const size_t* a, size_t n)
+{
+    if (n < 8)
+        return popcountWordsPopcnt(a, n);
+    return popcountWordsAvx2Impl(a, 0, n);
+}
+
+__attribute__((target("avx2,popcnt")))
+inline size_t andPopcountWordsAvx2(const size_t* a, const size_t* b, size_t n)
+{
+    if (n < 8)
+        return andPopcountWordsPopcnt(a, b, n);
+    return popcountWordsAvx2Impl(a, b, n);
+}
+
+__attribute__((target("avx2")))
+inline bool isSubsetWordsAvx2(const size_t* a, const size_t* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        if (!_mm256_testc_si256(_mm256_loadu_si256((const __m256i*)(b + i)),
+            _mm256_loadu_si256((const __m256i*)(a + i))))
+            return false;
+    for (; i < n; ++i)
+        if (a[i] & ~b[i])
+            return false;
+    return true;
+}
+
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+inline size_t popcountWordsAvx512(const size_t* a, size_t n)
+{
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        total = _mm512_add_epi64(total,
+            _mm512_popcnt_epi64(_mm512_loadu_si512(a + i)));
+    if (i < n)
+    {
+        __mmask8 mask = (__mmask8)((1u << (n - i)) - 1);
+        total = _mm512_add_epi64(total,
+            _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(mask, a + i)));
+    }
+    return (size_t)_mm512_reduce_add_epi64(total);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+inline size_t andPopcountWordsAvx512(const size_t* a, const size_t* b, size_t n)
+{
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_and_si512(
+            _mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i))));
+    if (i < n)
+    {
+        __mmask8 mask = (__mmask8)((1u << (n - i)) - 1);
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_and_si512(
+            _mm512_maskz_loadu_epi64(mask, a + i),
+            _mm512_maskz_loadu_epi64(mask, b + i))));
+    }
+    return (size_t)_mm512_reduce_add_epi64(total);
+}
+
+__attribute__((target("avx512f")))
+inline bool isSubsetWordsAvx512(const size_t* a, const size_t* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512i difference = _mm512_andnot_si512(_mm512_loadu_si512(b + i),
+            _mm512_loadu_si512(a + i));
+        if (_mm512_test_epi64_mask(difference, difference))
+            return false;
+    }
+    for (; i < n; ++i)
+        if (a[i] & ~b[i])
+            return false;
+    return true;
+}
+
+#endif // UTILS_X86_BIT_COUNT
+
+
+/* Kernels for bit counting chosen once by CPU features. */
+struct BitCountKernels
+{
+    size_t (*popcountWords)(const size_t* a, size_t n);
+    size_t (*andPopcountWords)(const size_t* a, const size_t* b, size_t n);
+    bool (*isSubsetWords)(const size_t* a, const size_t* b, size_t n);
+
+    static const BitCountKernels& get()
+    {
+        static const BitCountKernels kernels = select();
+        return kernels;
+    }
+
+private:
+
+    static BitCountKernels select()
+    {
+        BitCountKernels kernels = {&popcountWordsScalar,
+            &andPopcountWordsScalar, &isSubsetWordsScalar};
+#ifdef UTILS_X86_BIT_COUNT
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vpopcntdq"))
+        {
+            kernels.popcountWords = &popcountWordsAvx512;
+            kernels.andPopcountWords = &andPopcountWordsAvx512;
+            kernels.isSubsetWords = &isSubsetWordsAvx512;
+        }
+        else if (__builtin_cpu_supports("avx2") &&
+            __builtin_cpu_supports("popcnt"))
+        {
+            kernels.popcountWords = &popcountWordsAvx2;
+            kernels.andPopcountWords = &andPopcountWordsAvx2;
+            kernels.isSubsetWords = &isSubsetWordsAvx2;
+        }
+        else if (__builtin_cpu_supports("popcnt"))
+        {
+            kernels.popcountWords = &popcountWordsPopcnt;
+            kernels.andPopcountWords = &andPopcountWordsPopcnt;
+        }
+#endif
+        return kernels;
+    }
+};
+
+
+inline size_t popcountWords(const size_t* a, size_t n)
+{
+    return BitCountKernels::get().popcountWords(a, n);
+}
+
+inline size_t andPopcountWords(const size_t* a, const size_t* b, size_t n)
+{
+    return BitCountKernels::get().andPopcountWords(a, b, n);
+}
+
+inline bool isSubsetWords(const size_t* a, const size_t* b, size_t n)
+{
+    return BitCountKernels::get().isSubsetWords(a, b, n);
+}
+
+
+} // namespace Utils
+
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef UTILS_DOT_PRODUCT_HPP
+#define UTILS_DOT_PRODUCT_HPP
+
+
+#include <cstddef>
+
+// Vectorized kernels need GCC-compatible target attributes and CPU detection.
+#if defined(USE_SIMD) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define UTILS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+namespace Utils
+{
+
+
+/* Dot products for float, double and int vectors. AVX-512 or AVX2 versions
+are chosen at runtime when the CPU supports them, otherwise and for other
+types plain loops are used. Integer versions wrap on overflow exactly as the
+scalar ones. */
+
+
+template <typename T>
+T dotProductScalar(const T* a, const T* b, size_t n)
+{
+    T result = 0;
+    for (size_t i = 0; i < n; ++i)
+        result += a[i] * b[i];
+    return result;
+}
+
+
+#ifdef UTILS_X86_SIMD
+
+__attribute__((target("avx2")))
+inline double dotProductAvx2(const double* a, const double* b, size_t n)
+{
+    __m256d sum = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        sum = _mm256_add_pd(sum,
+            _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum),
+        _mm256_extractf128_pd(sum, 1));
+    double result = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    for (; i < n; ++i)
+        result += a[i] * b[i];
+    return result;
+}
+
+__attribute__((target("avx2")))
+inline float dotProductAvx2(const float* a, const float* b, size_t n)
+{
+    __m256 sum = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        sum = _mm256_add_ps(sum,
+            _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum),
+        _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    float result = _mm_cvtss_f32(half);
+    for (; i < n; ++i)
+        result += a[i] * b[i];
+    return result;
+}
+
+__attribute__((target("avx2")))
+inline int dotProductAvx2(const int* a, const int* b, size_t n)
+{
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(
+            _mm256_loadu_si256((const __m256i*)(a + i)),
+            _mm256_loadu_si256((const __m256i*)(b + i))));
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+        _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+    unsigned int result = (unsigned int)_mm_cvtsi128_si32(half);
+    for (; i < n; ++i)
+        result += (unsigned int)a[i] * (unsigned int)b[i];
+    return (int)result;
+}
+
+__attribute__((target("avx512f")))
+inline double dotProductAvx512(const double* a, const double* b, size_t n)
+{
+    __m512d sum = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        sum = _mm512_add_pd(sum,
+            _mm512_mul_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+    if (i < n)
+    {
+        __mmask8 mask = (__mmask8)((1u << (n - i)) - 1);
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(
+            _mm512_maskz_loadu_pd(mask, a + i), _mm512_maskz_loadu_pd(mask, b + i)));
+    }
+    return _mm512_reduce_add_pd(sum);
+}
+
+__attribute__((target("avx512f")))
+inline float dotProductAvx512(const float* a, const float* b, size_t n)
+{
+    __m512 sum = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        sum = _mm512_add_ps(sum,
+            _mm512_mul_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    if (i < n)
+    {
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(
+            _mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i)));
+    }
+    return _mm512_reduce_add_ps(sum);
+}
+
+__attribute__((target("avx512f")))
+inline int dotProductAvx512(const int* a, const int* b, size_t n)
+{
+    __m512i sum = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        sum = _mm512_add_epi32(sum, _mm512_mullo_epi32(
+            _mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)));
+    if (i < n)
+    {
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        sum = _mm512_add_epi32(sum, _mm512_mullo_epi32(
+            _mm512_maskz_loadu_epi32(mask, a + i),
+            _mm512_maskz_loadu_epi32(mask, b + i)));
+    }
+    return _mm512_reduce_add_epi32(sum);
+}
+
+#endif // UTILS_X86_SIMD
+
+
+/* Kernel for type T chosen once by CPU features. */
+template <typename T>
+struct DotProductKernel
+{
+    typedef T (*Function)(const T*, const T*, size_t);
+
+    static Function get()
+    {
+        static const Function function = select();
+        return function;
+    }
+
+private:
+
+    static Function select();
+};
+
+template <typename T>
+typename DotProductKernel<T>::Function DotProductKernel<T>::select()
+{
+    return &dotProductScalar<T>;
+}
+
+#ifdef UTILS_X86_SIMD
+
+#define UTILS_SELECT_DOT_PRODUCT(T) \
+template <> \
+inline DotProductKernel<T>::Function DotProductKernel<T>::select() \
+{ \
+    __builtin_cpu_init(); \
+    if (__builtin_cpu_supports("avx512f")) \
+        return static_cast<Function>(&dotProductAvx512); \
+    if (__builtin_cpu_supports("avx2")) \
+        return static_cast<Function>(&dotProductAvx2); \
+    return &dotProductScalar<T>; \
+}
+
+UTILS_SELECT_DOT_PRODUCT(double)
+UTILS_SELECT_DOT_PRODUCT(float)
+UTILS_SELECT_DOT_PRODUCT(int)
+
+#undef UTILS_SELECT_DOT_PRODUCT
+
+#endif // UTILS_X86_SIMD
+
+
+template <typename T>
+inline T dotProduct(const T* a, const T* b, size_t n)
+{
+    return DotProductKernel<T>::get()(a, b, n);
+}
+
+
+/* Dot products of x with each of numVectors vectors of size n, e.g. of one
+inequality with a batch of rays or of one ray with several inequalities. */
+template <typename T>
+void dotProducts(const T* x, const T* const* vectors, size_t numVectors,
+    size_t n, T* result)
+{
+    typename DotProductKernel<T>::Function function = DotProductKernel<T>::get();
+    for (size_t i = 0; i < numVectors; ++i)
+        result[i] = function(x, vectors[i], n);
+}
+
+
+/* Dot products of x with numVectors vectors of size n stored one after
+another with given stride, e.g. of one inequality with all rays in an arena. */
+template <typename T>
+void dotProductsStrided(const T* x, const T* vectors, size_t numVectors,
+    size_t stride, size_t n, T* result)
+{
+    typename DotProductKernel<T>::Function function = DotProductKernel<T>::get();
+    for (size_t i = 0; i < numVectors; ++i)
+        result[i] = function(x, vectors + i * stride, n);
+}
+
+
+} // namespace Utils
+
+
+#endif
@@ -3,19 +3,187 @@
 
 
 #include "Gcd.hpp"
+#include "Integer.hpp"
 #include "Matrix.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 
 namespace Utils
 {
 
 
+/* Position of pivot for i-th step of gauss() in given row: the first
+element of maximal absolute value among positions i .. maxBas - 1, positions
+are mapped to columns by perm. */
+template <typename T>
+size_t gaussPivotPosition(const T* row, const std::vector<size_t>& perm,
+    size_t i, size_t maxBas)
+{
+    using std::abs;
+    size_t j_pivot = i;
+    T q_pivot = abs(row[perm[i]]);
+    for (size_t j = i + 1; j < maxBas; ++j)
+        if (abs(row[perm[j]]) > q_pivot)
+        {
+            j_pivot = j;
+            q_pivot = abs(row[perm[j]]);
+        }
+    return j_pivot;
+}
+
+
+/* Move i-th active row of gauss() working buffer to basis. */
+template <typename T>
+void gaussMoveToBasis(std::vector<T>& w, size_t width, size_t m,
+    std::vector<size_t>& rows, size_t i, bool intarith, Matrix<T>& bas)
+{
+    T* row = &w[rows[i] * width];
+    if (intarith)
+        normalizeIntVector(row, width);
+    bas.insert_row(bas.nrows(), row + m);
+    rows.erase(rows.begin() + i);
+}
+
+
+/* Fraction-free Gauss-Jordan elimination of Bareiss: each row is updated as
+(pivot * row - row[col] * pivotRow) / previousPivot, the division is exact.
+Return number of pivots. */
+template <typename T>
+size_t gaussBareiss(std::vector<T>& w, size_t width, size_t m, size_t maxBas,
+    const T& eps, std::vector<size_t>& perm, std::vector<size_t>& rows,
+    Matrix<T>& bas)
+{
+    using std::abs;
+    T previousPivot = 1;
+    size_t i = 0;
+    while (i < std::min(m, rows.size()))
+    {
+        T* pivotRow = &w[rows[i] * width];
+        size_t j_pivot = gaussPivotPosition(pivotRow, perm, i, maxBas);
+        if (abs(pivotRow[perm[j_pivot]]) <= eps)
+        {
+            gaussMoveToBasis(w, width, m, rows, i, true, bas);
+            continue;
+        }
+        std::swap(perm[i], perm[j_pivot]);
+        const size_t col = perm[i];
+        if (pivotRow[col] < 0)
+            for (size_t k = 0; k < width; ++k)
+                pivotRow[k] = -pivotRow[k];
+        const T pivot = pivotRow[col];
+        for (size_t r = 0; r < rows.size(); ++r)
+        {
+            if (r == i)
+                continue;
+            T* row = &w[rows[r] * width];
+            const T factor = row[col];
+            for (size_t k = 0; k < width; ++k)
+                row[k] = mulSub(pivot, row[k], factor, pivotRow[k]) /
+                    previousPivot;
+        }
+        previousPivot = pivot;
+        ++i;
+    }
+    return i;
+}
+
+
+/* Floating-point Gauss-Jordan elimination by blocks of pivots. Rows of a
+block are eliminated by previous pivots of the block and reduced with respect
+to each other, then all other rows are updated by the whole block in one pass
+over them. Return number of pivots. */
+template <typename T>
+size_t gaussBlocked(std::vector<T>& w, size_t width, size_t m, size_t maxBas,
+    const T& eps, std::vector<size_t>& perm, std::vector<size_t>& rows,
+    Matrix<T>& bas)
+{
+    using std::abs;
+    const size_t blockSize = 8;
+    size_t i = 0;
+    while (i < std::min(m, rows.size()))
+    {
+        // find pivots of the block
+        const size_t begin = i;
+        while ((i - begin < blockSize) && (i < std::min(m, rows.size())))
+        {
+            T* row = &w[rows[i] * width];
+            for (size_t t = begin; t < i; ++t)
+            {
+                const T factor = row[perm[t]];
+                const T* pivotRow = &w[rows[t] * width];
+                if (factor != 0)
+                    for (size_t k = 0; k < width; ++k)
+                        row[k] -= factor * pivotRow[k];
+            }
+            size_t j_pivot = gaussPivotPosition(row, perm, i, maxBas);
+            if (abs(row[perm[j_pivot]]) <= eps)
+            {
+                gaussMoveToBasis(w, width, m, rows, i, false, bas);
+                continue;
+            }
+            std::swap(perm[i], perm[j_pivot]);
+            const T pivot = row[perm[i]];
+            for (size_t k = 0; k < width; ++k)
+                row[k] /= pivot;
+            ++i;
+        }
+
+        // reduce rows of the block by later pivots of the block
+        for (size_t t = i; t > begin + 1; --t)
+        {
+            const T* pivotRow = &w[rows[t - 1] * width];
+            for (size_t r = begin; r < t - 1; ++r)
+            {
+                T* row = &w[rows[r] * width];
+                const T factor = row[perm[t - 1]];
+                if (factor != 0)
+                    for (size_t k = 0; k < width; ++k)
+                        row[k] -= factor * pivotRow[k];
+            }
+        }
+
+        // update other rows by the block
+        std::vector<T> factors(i - begin);
+        std::vector<const T*> pivotRows(i - begin);
+        for (size_t t = begin; t < i; ++t)
+            pivotRows[t - begin] = &w[rows[t] * width];
+        for (size_t r = 0; r < rows.size(); ++r)
+        {
+            if ((r >= begin) && (r < i))
+                continue;
+            T* row = &w[rows[r] * width];
+            bool isAffected = false;
+            for (size_t t = begin; t < i; ++t)
+            {
+                factors[t - begin] = row[perm[t]];
+                isAffected = isAffected || (factors[t - begin] != 0);
+            }
+            if (!isAffected)
+                continue;
+            for (size_t k = 0; k < width; ++k)
+            {
+                T value = row[k];
+                for (size_t t = 0; t < factors.size(); ++t)
+                    value -= factors[t] * pivotRows[t][k];
+                row[k] = value;
+            }
+        }
+    }
+    return i;
+}
+
+
 /* Gaussian elimination: using elementary transforms of rows of transpose(a)
 and column permutation simplify it to diagonal matrix q:
 f * transpose(a) * P = q, find rank and basis submatrix bas.
-Only use rows 0 .. maxBas - 1.*/
+Only use rows 0 .. maxBas - 1.
+Rows of transpose(a) followed by rows of f are kept in one buffer, zero rows
+are only excluded from the list of active rows and columns are permuted via
+perm. Integer arithmetic uses fraction-free elimination and normalizes rows
+once at the end, floating-point one is blocked. */
 template <typename T>
 void gauss(
     const Matrix<T>& a,
@@ -27,103 +195,149 @@ void gauss(
     bool intarith,
     const T& eps )
 {
-    size_t m = a.nrows();
-    size_t n = a.ncols();
-    f.assign_eye( n );
-    bas.resize(0, n);
-    Matrix<T>& q  = transpose( a );
+    const size_t m = a.nrows();
+    const size_t n = a.ncols();
+    const size_t width = m + n;
+    std::vector<T> w(n * width, (T)0);
+    for (size_t r = 0; r < n; ++r)
+    {
+        for (size_t c = 0; c < m; ++c)
+            w[r * width + c] = a(c, r);
+        w[r * width + m + r] = 1;
+    }
+    std::vector<size_t> rows(n);
+    for (size_t r = 0; r < n; ++r)
+        rows[r] = r;
     perm.resize(m);
     for (size_t i = 0; i < m; ++i)
         perm[i] = i;
+    bas.resize(0, n);
 
-    // main loop of elimination
-    for (size_t i = 0; i < std::min(q.ncols(), q.nrows()); )
+    if (intarith)
+        rank = gaussBareiss(w, width, m, maxBas, eps, perm, rows, bas);
+    else
+        rank = gaussBlocked(w, width, m, maxBas, eps, perm, rows, bas);
+
+    // Make f of pivot rows and basic submatrix of the others.
+    if (intarith)
+        for (size_t r = 0; r < rows.size(); ++r)
+            normalizeIntVector(&w[rows[r] * width], width);
+    f.resize(rank, n);
+    for (size_t r = 0; r < rank; ++r)
+        std::copy(&w[rows[r] * width + m], &w[rows[r] * width] + width,
+            f.row(r));
+    for (size_t r = rank; r < rows.size(); ++r)
+        bas.insert_row(bas.nrows(), &w[rows[r] * width + m]);
+}
+
+
+/* Rank of m x n matrix stored by rows in array a, a is destroyed.
+For integer arithmetic elimination is fraction-free. */
+template <typename T>
+size_t matrixRank(T* a, size_t m, size_t n, bool intarith, const T& eps)
+{
+    using std::abs;
+    size_t rank = 0;
+    for (size_t col = 0; (col < n) && (rank < m); ++col)
     {
-        // find non-zero entry in the i-th row beginning from i-th entry
-        T q_pivot = std::abs(q(i, i));
-        size_t j_pivot = i;
-        for (size_t j = i + 1; j < maxBas; ++j)
-        {
-            if (std::abs(q(i, j)) > q_pivot)
+        // find pivot in col-th column among not yet used rows
+        size_t i_pivot = rank;
+        T a_pivot = abs(a[rank * n + col]);
+        for (size_t i = rank + 1; i < m; ++i)
+            if (abs(a[i * n + col]) > a_pivot)
             {
-                j_pivot = j;
-                q_pivot = std::abs(q(i, j));
+                i_pivot = i;
+                a_pivot = abs(a[i * n + col]);
             }
-        }
-        if( q_pivot <= eps )
-        {
-            // it's a zero row
-            q.erase_row(i);
-            bas.insert_row( bas.nrows(), f.row(i));
-            f.erase_row(i);
+        if (a_pivot <= eps)
             continue;
-        }
+        if (i_pivot != rank)
+            for (size_t k = col; k < n; ++k)
+                std::swap(a[rank * n + k], a[i_pivot * n + k]);
 
-        if (i != j_pivot)
+        // make zeroes in col-th column below pivot
+        const T* pivotRow = a + rank * n;
+        for (size_t i = rank + 1; i < m; ++i)
         {
-            q.swap_cols(i, j_pivot);
-            std::swap(perm[i], perm[j_pivot]);
-        }
-
-        if (q(i, i) < 0)
-        {
-            q.mult_row(i, -1);
-            f.mult_row(i, -1);
-        }
-
-        // make all zeroes in i-th column
-        if( intarith )
-        {
-            T b = q(i, i);
-            size_t mm = q.nrows();
-            for( size_t ii = 0; ii < mm; ++ii )
+            T* row = a + i * n;
+            if (abs(row[col]) <= eps)
+                continue;
+            if (intarith)
             {
-                if( ii != i )
-                {
-                    T b_ii = q( ii, i );
-                    T alpha = Utils::gcd( b, b_ii );
-                    T b_i = b / alpha;
-                    b_ii = -b_ii / alpha;
-                    q.mult_row( ii, b_i );
-                    q.addmult_rows( ii, i, b_ii );
-                    f.mult_row( ii, b_i );
-                    f.addmult_rows( ii, i, b_ii );
-
-                    alpha = Utils::gcd(Utils::gcd(q.row(ii), q.ncols()),
-                                       Utils::gcd(f.row(ii), f.ncols()));
-                    q.div_row(ii, alpha);
-                    f.div_row(ii, alpha);
-                }
+                T alpha = Utils::gcd(pivotRow[col], row[col]);
+                T b_pivot = pivotRow[col] / alpha;
+                T b_i = row[col] / alpha;
+                for (size_t k = col; k < n; ++k)
+                    row[k] = row[k] * b_pivot - pivotRow[k] * b_i;
+                normalizeIntVector(row + col, n - col);
             }
-        }
-        else
-        {
-            T b = q(i, i);
-            q.div_row(i, b);
-            f.div_row(i, b);
-
-            size_t mm = q.nrows();
-            for (size_t ii = 0; ii < mm; ++ii)
+            else
             {
-                if (ii != i)
-                {
-                    T b_ii = -q(ii, i);
-                    q.addmult_rows(ii, i, b_ii);
-                    f.addmult_rows(ii, i, b_ii);
-                }
+                T b_i = row[col] / pivotRow[col];
+                for (size_t k = col; k < n; ++k)
+                    row[k] -= pivotRow[k] * b_i;
             }
         }
-        // go to the next row
-        ++i;
+        ++rank;
+    }
+    return rank;
+}
+
+
+/* If m x n integer matrix stored by rows in array a has one-dimensional null
+space, put its primitive generator to x and return true. a is destroyed.
+Uses fraction-free Gauss-Jordan elimination. */
+template <typename T>
+bool integerNullVector(T* a, size_t m, size_t n, T* x)
+{
+    std::vector<size_t> pivotCols;
+    for (size_t col = 0; (col < n) && (pivotCols.size() < m); ++col)
+    {
+        const size_t rank = pivotCols.size();
+        size_t i_pivot = rank;
+        while ((i_pivot < m) && !a[i_pivot * n + col])
+            ++i_pivot;
+        if (i_pivot == m)
+            continue;
+        if (i_pivot != rank)
+            for (size_t k = 0; k < n; ++k)
+                std::swap(a[rank * n + k], a[i_pivot * n + k]);
+
+        // make zeroes in col-th column in all other rows
+        const T* pivotRow = a + rank * n;
+        for (size_t i = 0; i < m; ++i)
+        {
+            T* row = a + i * n;
+            if ((i == rank) || !row[col])
+                continue;
+            T alpha = Utils::gcd(pivotRow[col], row[col]);
+            T b_pivot = pivotRow[col] / alpha;
+            T b_i = row[col] / alpha;
+            for (size_t k = 0; k < n; ++k)
+                row[k] = row[k] * b_pivot - pivotRow[k] * b_i;
+            normalizeIntVector(row, n);
+        }
+        pivotCols.push_back(col);
     }
+    if (pivotCols.size() + 1 != n)
+        return false;
 
-    // Make basic submatrix
-    rank = std::min(q.ncols(), q.nrows());
-    for( size_t i = rank; i < q.nrows(); ++i )
+    // now row r only has elements in columns pivotCols[r] and freeCol
+    size_t freeCol = 0;
+    while ((freeCol < pivotCols.size()) && (pivotCols[freeCol] == freeCol))
+        ++freeCol;
+    T multiple = 1;
+    for (size_t r = 0; r < pivotCols.size(); ++r)
     {
-        bas.insert_row(bas.nrows(), f.row(rank));
-        f.erase_row(rank);
+        const T& pivot = a[r * n + pivotCols[r]];
+        multiple = multiple / Utils::gcd(multiple, pivot) * pivot;
     }
+    x[freeCol] = multiple;
+    for (size_t r = 0; r < pivotCols.size(); ++r)
+        x[pivotCols[r]] =
+            -a[r * n + freeCol] * (multiple / a[r * n + pivotCols[r]]);
+    normalizeIntVector(x, n);
+    return true;
 }
 
 
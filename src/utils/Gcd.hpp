@@ -73,10 +73,11 @@ template<typename T>
 void normalizeFPVector(T* vector, size_t size)
 {
     // Divide vector by max by absolute value element.
-    T maxAbsElement = std::abs(vector[0]);
+    using std::abs;
+    T maxAbsElement = abs(vector[0]);
     for (size_t i = 1; i < size; ++i)
-        if (std::abs(vector[i]) > maxAbsElement)
-            maxAbsElement = std::abs(vector[i]);
+        if (abs(vector[i]) > maxAbsElement)
+            maxAbsElement = abs(vector[i]);
     if (maxAbsElement)
         for (size_t i = 0; i < size; ++i)
             vector[i] /= maxAbsElement;
@@ -0,0 +1,721 @@
+#ifndef UTILS_INTEGER_HPP
+#define UTILS_INTEGER_HPP
+
+
+#include "BinaryIO.hpp"
+#include "DotProduct.hpp"
+#include "Gcd.hpp"
+
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+namespace Utils
+{
+
+
+/* Arbitrary-precision integer in sign-magnitude form, magnitude is stored by
+32-bit limbs from the least significant one without leading zero limbs. Zero
+has no limbs and is not negative. Used by Integer for values not fitting into
+64 bits, so it is simple rather than fast. */
+class BigInteger
+{
+public:
+
+    BigInteger(): negative(false) {}
+
+    explicit BigInteger(int64_t value): negative(value < 0)
+    {
+        uint64_t magnitude = negative ? 0 - (uint64_t)value : (uint64_t)value;
+        setMagnitude(magnitude, 0);
+    }
+
+#ifdef __SIZEOF_INT128__
+    explicit BigInteger(__int128 value): negative(value < 0)
+    {
+        unsigned __int128 magnitude = negative ?
+            0 - (unsigned __int128)value : (unsigned __int128)value;
+        setMagnitude((uint64_t)magnitude, (uint64_t)(magnitude >> 64));
+    }
+#endif
+
+    bool isZero() const { return limbs.empty(); }
+    bool isNegative() const { return negative; }
+
+    bool fitsInt64() const
+    {
+        if (limbs.size() <= 1)
+            return true;
+        if (limbs.size() > 2)
+            return false;
+        uint64_t magnitude = ((uint64_t)limbs[1] << 32) | limbs[0];
+        return negative ? (magnitude <= ((uint64_t)1 << 63)) :
+            (magnitude < ((uint64_t)1 << 63));
+    }
+
+    // Value if fitsInt64() is true.
+    int64_t toInt64() const
+    {
+        uint64_t magnitude = 0;
+        for (size_t i = limbs.size(); i > 0; --i)
+            magnitude = (magnitude << 32) | limbs[i - 1];
+        return negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    }
+
+    double toDouble() const
+    {
+        double result = 0;
+        for (size_t i = limbs.size(); i > 0; --i)
+            result = result * 4294967296.0 + limbs[i - 1];
+        return negative ? -result : result;
+    }
+
+    void negate()
+    {
+        if (!isZero())
+            negative = !negative;
+    }
+
+    friend int compare(const BigInteger& a, const BigInteger& b)
+    {
+        if (a.negative != b.negative)
+            return a.negative ? -1 : 1;
+        int result = compareMagnitudes(a.limbs, b.limbs);
+        return a.negative ? -result : result;
+    }
+
+    friend BigInteger operator +(const BigInteger& a, const BigInteger& b)
+    {
+        BigInteger result;
+        if (a.negative == b.negative)
+        {
+            addMagnitudes(a.limbs, b.limbs, result.limbs);
+            result.negative = a.negative;
+        }
+        else if (compareMagnitudes(a.limbs, b.limbs) >= 0)
+        {
+            subtractMagnitudes(a.limbs, b.limbs, result.limbs);
+            result.negative = a.negative;
+        }
+        else
+        {
+            subtractMagnitudes(b.limbs, a.limbs, result.limbs);
+            result.negative = b.negative;
+        }
+        result.trim();
+        return result;
+    }
+
+    friend BigInteger operator -(const BigInteger& a, const BigInteger& b)
+    {
+        BigInteger minusB(b);
+        minusB.negate();
+        return a + minusB;
+    }
+
+    friend BigInteger operator *(const BigInteger& a, const BigInteger& b)
+    {
+        BigInteger result;
+        if (a.isZero() || b.isZero())
+            return result;
+        result.limbs.assign(a.limbs.size() + b.limbs.size(), 0);
+        for (size_t i = 0; i < a.limbs.size(); ++i)
+        {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < b.limbs.size(); ++j)
+            {
+                uint64_t t = (uint64_t)a.limbs[i] * b.limbs[j] +
+                    result.limbs[i + j] + carry;
+                result.limbs[i + j] = (uint32_t)t;
+                carry = t >> 32;
+            }
+            result.limbs[i + b.limbs.size()] = (uint32_t)carry;
+        }
+        result.negative = (a.negative != b.negative);
+        result.trim();
+        return result;
+    }
+
+    /* Division with truncation toward zero as for built-in types. */
+    friend void divide(const BigInteger& a, const BigInteger& b,
+        BigInteger& quotient, BigInteger& remainder)
+    {
+        quotient = BigInteger();
+        remainder = BigInteger();
+        if (compareMagnitudes(a.limbs, b.limbs) < 0)
+        {
+            remainder = a;
+            return;
+        }
+        divideMagnitudes(a.limbs, b.limbs, quotient.limbs, remainder.limbs);
+        quotient.negative = (a.negative != b.negative);
+        remainder.negative = a.negative;
+        quotient.trim();
+        remainder.trim();
+    }
+
+    std::string toString() const
+    {
+        if (isZero())
+            return "0";
+        std::vector<uint32_t> magnitude(limbs);
+        std::string digits;
+        while (!magnitude.empty())
+        {
+            // divide by 10^9 and write 9 digits of remainder
+            uint64_t remainder = 0;
+            for (size_t i = magnitude.size(); i > 0; --i)
+            {
+                uint64_t t = (remainder << 32) | magnitude[i - 1];
+                magnitude[i - 1] = (uint32_t)(t / 1000000000);
+                remainder = t % 1000000000;
+            }
+            while (!magnitude.empty() && !magnitude.back())
+                magnitude.pop_back();
+            for (int k = 0; k < 9; ++k)
+            {
+                digits += (char)('0' + remainder % 10);
+                remainder /= 10;
+                if (magnitude.empty() && !remainder)
+                    break;
+            }
+        }
+        if (negative)
+            digits += '-';
+        return std::string(digits.rbegin(), digits.rend());
+    }
+
+    /* Parse optionally signed decimal integer, return if succeeded. */
+    bool parse(const std::string& s)
+    {
+        limbs.clear();
+        negative = false;
+        size_t i = 0;
+        if ((i < s.size()) && ((s[i] == '-') || (s[i] == '+')))
+            negative = (s[i++] == '-');
+        if (i == s.size())
+            return false;
+        for (; i < s.size(); ++i)
+        {
+            if ((s[i] < '0') || (s[i] > '9'))
+                return false;
+            // multiply by 10 and add digit
+            uint64_t carry = (uint64_t)(s[i] - '0');
+            for (size_t j = 0; j < limbs.size(); ++j)
+            {
+                uint64_t t = (uint64_t)limbs[j] * 10 + carry;
+                limbs[j] = (uint32_t)t;
+                carry = t >> 32;
+            }
+            if (carry)
+                limbs.push_back((uint32_t)carry);
+        }
+        trim();
+        return true;
+    }
+
+    void write(std::ostream& os) const
+    {
+        Utils::writeBinary(os, negative);
+        Utils::writeBinary(os, (uint32_t)limbs.size());
+        if (!limbs.empty())
+            Utils::writeBinary(os, &limbs[0], limbs.size());
+    }
+
+    bool read(std::istream& is)
+    {
+        uint32_t numLimbs = 0;
+        if (!Utils::readBinary(is, negative) || !Utils::readBinary(is, numLimbs))
+            return false;
+        limbs.resize(numLimbs);
+        if (numLimbs && !Utils::readBinary(is, &limbs[0], numLimbs))
+            return false;
+        trim();
+        return true;
+    }
+
+private:
+
+    bool negative;
+    std::vector<uint32_t> limbs;
+
+    void setMagnitude(uint64_t low, uint64_t high)
+    {
+        limbs.push_back((uint32_t)low);
+        limbs.push_back((uint32_t)(low >> 32));
+        limbs.push_back((uint32_t)high);
+        limbs.push_back((uint32_t)(high >> 32));
+        trim();
+    }
+
+    void trim()
+    {
+        while (!limbs.empty() && !limbs.back())
+            limbs.pop_back();
+        if (limbs.empty())
+            negative = false;
+    }
+
+    static int compareMagnitudes(const std::vector<uint32_t>& a,
+        const std::vector<uint32_t>& b)
+    {
+        if (a.size() != b.size())
+            return (a.size() < b.size()) ? -1 : 1;
+        for (size_t i = a.size(); i > 0; --i)
+            if (a[i - 1] != b[i - 1])
+                return (a[i - 1] < b[i - 1]) ? -1 : 1;
+        return 0;
+    }
+
+    static void addMagnitudes(const std::vector<uint32_t>& a,
+        const std::vector<uint32_t>& b, std::vector<uint32_t>& result)
+    {
+        const std::vector<uint32_t>& longer = (a.size() >= b.size()) ? a : b;
+        const std::vector<uint32_t>& shorter = (a.size() >= b.size()) ? b : a;
+        result.resize(longer.size() + 1);
+        uint64_t carry = 0;
+        for (size_t i = 0; i < longer.size(); ++i)
+        {
+            uint64_t t = (uint64_t)longer[i] +
+                (i < shorter.size() ? shorter[i] : 0) + carry;
+            result[i] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        result[longer.size()] = (uint32_t)carry;
+    }
+
+    // |a| >= |b| is required.
+    static void subtractMagnitudes(const std::vector<uint32_t>& a,
+        const std::vector<uint32_t>& b, std::vector<uint32_t>& result)
+    {
+        result.resize(a.size());
+        int64_t borrow = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            int64_t t = (int64_t)a[i] - (i < b.size() ? b[i] : 0) - borrow;
+            borrow = (t < 0) ? 1 : 0;
+            result[i] = (uint32_t)(t + (borrow << 32));
+        }
+    }
+
+    /* Knuth's algorithm D, |u| >= |v| > 0 is required. */
+    static void divideMagnitudes(const std::vector<uint32_t>& u,
+        const std::vector<uint32_t>& v, std::vector<uint32_t>& q,
+        std::vector<uint32_t>& r)
+    {
+        const size_t m = u.size(), n = v.size();
+        q.assign(m - n + 1, 0);
+        if (n == 1)
+        {
+            uint64_t remainder = 0;
+            for (size_t i = m; i > 0; --i)
+            {
+                uint64_t t = (remainder << 32) | u[i - 1];
+                q[i - 1] = (uint32_t)(t / v[0]);
+                remainder = t % v[0];
+            }
+            r.assign(1, (uint32_t)remainder);
+            return;
+        }
+
+        // normalize so that the highest bit of divisor is set
+        int shift = 0;
+        while (!(v[n - 1] & (0x80000000u >> shift)))
+            ++shift;
+        std::vector<uint32_t> vn(n), un(m + 1);
+        for (size_t i = n - 1; i > 0; --i)
+            vn[i] = (v[i] << shift) |
+                (shift ? (uint32_t)((uint64_t)v[i - 1] >> (32 - shift)) : 0);
+        vn[0] = v[0] << shift;
+        un[m] = shift ? (uint32_t)((uint64_t)u[m - 1] >> (32 - shift)) : 0;
+        for (size_t i = m - 1; i > 0; --i)
+            un[i] = (u[i] << shift) |
+                (shift ? (uint32_t)((uint64_t)u[i - 1] >> (32 - shift)) : 0);
+        un[0] = u[0] << shift;
+
+        const uint64_t base = (uint64_t)1 << 32;
+        for (size_t j = m - n + 1; j > 0; --j)
+        {
+            const size_t k = j - 1;
+            uint64_t numerator = ((uint64_t)un[k + n] << 32) | un[k + n - 1];
+            uint64_t qhat = numerator / vn[n - 1];
+            uint64_t rhat = numerator % vn[n - 1];
+            while ((qhat >= base) ||
+                (qhat * vn[n - 2] > ((rhat << 32) | un[k + n - 2])))
+            {
+                --qhat;
+                rhat += vn[n - 1];
+                if (rhat >= base)
+                    break;
+            }
+            // multiply and subtract
+            int64_t borrow = 0, t;
+            for (size_t i = 0; i < n; ++i)
+            {
+                uint64_t p = qhat * vn[i];
+                t = (int64_t)un[i + k] - borrow - (int64_t)(p & 0xFFFFFFFFu);
+                un[i + k] = (uint32_t)t;
+                borrow = (int64_t)(p >> 32) - (t >> 32);
+            }
+            t = (int64_t)un[k + n] - borrow;
+            un[k + n] = (uint32_t)t;
+            q[k] = (uint32_t)qhat;
+            if (t < 0)
+            {
+                // add back
+                --q[k];
+                uint64_t carry = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    uint64_t s = (uint64_t)un[i + k] + vn[i] + carry;
+                    un[i + k] = (uint32_t)s;
+                    carry = s >> 32;
+                }
+                un[k + n] = (uint32_t)(un[k + n] + carry);
+            }
+        }
+
+        r.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            r[i] = (un[i] >> shift) |
+                (shift ? (uint32_t)((uint64_t)un[i + 1] << (32 - shift)) : 0);
+    }
+};
+
+
+/* Exact integer working on int64 while values fit, operations check for
+overflow and switch to BigInteger otherwise. Value is kept big only if it
+does not fit into int64. */
+class Integer
+{
+public:
+
+    Integer(): small(0), big(0) {}
+    Integer(int value): small(value), big(0) {}
+    Integer(long value): small(value), big(0) {}
+    Integer(long long value): small(value), big(0) {}
+    explicit Integer(double value): small((int64_t)value), big(0) {}
+
+    Integer(const Integer& a):
+        small(a.small), big(a.big ? new BigInteger(*a.big) : 0) {}
+
+    ~Integer() { delete big; }
+
+    Integer& operator =(const Integer& a)
+    {
+        if (this != &a)
+        {
+            if (a.big)
+            {
+                if (big)
+                    *big = *a.big;
+                else
+                    big = new BigInteger(*a.big);
+            }
+            else
+            {
+                delete big;
+                big = 0;
+            }
+            small = a.small;
+        }
+        return *this;
+    }
+
+    bool isBig() const { return big != 0; }
+
+    explicit operator bool() const { return big || small; }
+
+    explicit operator double() const
+    { return big ? big->toDouble() : (double)small; }
+
+    explicit operator float() const
+    { return (float)(double)*this; }
+
+    friend Integer operator +(const Integer& a, const Integer& b)
+    {
+        int64_t result;
+        if (!a.big && !b.big && !addOverflow(a.small, b.small, result))
+            return Integer(result);
+        return Integer(a.toBig() + b.toBig());
+    }
+
+    friend Integer operator -(const Integer& a, const Integer& b)
+    {
+        int64_t result;
+        if (!a.big && !b.big && !subtractOverflow(a.small, b.small, result))
+            return Integer(result);
+        return Integer(a.toBig() - b.toBig());
+    }
+
+    friend Integer operator *(const Integer& a, const Integer& b)
+    {
+        int64_t result;
+        if (!a.big && !b.big)
+        {
+            if (!multiplyOverflow(a.small, b.small, result))
+                return Integer(result);
+#ifdef __SIZEOF_INT128__
+            return Integer((__int128)a.small * b.small);
+#endif
+        }
+        return Integer(a.toBig() * b.toBig());
+    }
+
+    friend Integer operator /(const Integer& a, const Integer& b)
+    {
+        if (!a.big && !b.big && !((a.small == INT64_MIN) && (b.small == -1)))
+            return Integer(a.small / b.small);
+        BigInteger quotient, remainder;
+        divide(a.toBig(), b.toBig(), quotient, remainder);
+        return Integer(quotient);
+    }
+
+    friend Integer operator %(const Integer& a, const Integer& b)
+    {
+        if (!a.big && !b.big)
+            return Integer((b.small == -1) ? 0 : a.small % b.small);
+        BigInteger quotient, remainder;
+        divide(a.toBig(), b.toBig(), quotient, remainder);
+        return Integer(remainder);
+    }
+
+    Integer operator -() const
+    {
+        if (!big && (small != INT64_MIN))
+            return Integer(-small);
+        BigInteger result = toBig();
+        result.negate();
+        return Integer(result);
+    }
+
+    Integer& operator +=(const Integer& a) { return *this = *this + a; }
+    Integer& operator -=(const Integer& a) { return *this = *this - a; }
+    Integer& operator *=(const Integer& a) { return *this = *this * a; }
+    Integer& operator /=(const Integer& a) { return *this = *this / a; }
+
+    friend int compare(const Integer& a, const Integer& b)
+    {
+        if (!a.big && !b.big)
+            return (a.small < b.small) ? -1 : ((a.small > b.small) ? 1 : 0);
+        return compare(a.toBig(), b.toBig());
+    }
+
+    friend bool operator ==(const Integer& a, const Integer& b)
+    { return compare(a, b) == 0; }
+    friend bool operator !=(const Integer& a, const Integer& b)
+    { return compare(a, b) != 0; }
+    friend bool operator <(const Integer& a, const Integer& b)
+    { return compare(a, b) < 0; }
+    friend bool operator >(const Integer& a, const Integer& b)
+    { return compare(a, b) > 0; }
+    friend bool operator <=(const Integer& a, const Integer& b)
+    { return compare(a, b) <= 0; }
+    friend bool operator >=(const Integer& a, const Integer& b)
+    { return compare(a, b) >= 0; }
+
+    friend Integer abs(const Integer& a)
+    { return (a < 0) ? -a : a; }
+
+    /* a * b - c * d, for int64 values computed without intermediate
+    big numbers. */
+    friend Integer mulSub(const Integer& a, const Integer& b,
+        const Integer& c, const Integer& d)
+    {
+#ifdef __SIZEOF_INT128__
+        if (!a.big && !b.big && !c.big && !d.big)
+            return Integer((__int128)a.small * b.small -
+                (__int128)c.small * d.small);
+#endif
+        return a * b - c * d;
+    }
+
+    /* Dot product accumulated in 128 bits while possible. */
+    static Integer dotProduct(const Integer* a, const Integer* b, size_t n)
+    {
+        size_t i = 0;
+        Integer result;
+#ifdef __SIZEOF_INT128__
+        __int128 sum = 0;
+        for (; i < n; ++i)
+        {
+            __int128 next;
+            if (a[i].big || b[i].big || __builtin_add_overflow(sum,
+                (__int128)a[i].small * b[i].small, &next))
+                break;
+            sum = next;
+        }
+        result = Integer(sum);
+#endif
+        for (; i < n; ++i)
+            result += a[i] * b[i];
+        return result;
+    }
+
+    friend std::ostream& operator <<(std::ostream& os, const Integer& a)
+    {
+        if (a.big)
+            return os << a.big->toString();
+        return os << (long long)a.small;
+    }
+
+    friend std::istream& operator >>(std::istream& is, Integer& a)
+    {
+        std::string s;
+        BigInteger value;
+        if ((is >> s) && value.parse(s))
+            a = Integer(value);
+        else
+            is.setstate(std::ios::failbit);
+        return is;
+    }
+
+    /* Binary form is a flag of big value followed by either int64 or
+    BigInteger data. */
+    friend void writeBinary(std::ostream& os, const Integer& a)
+    {
+        Utils::writeBinary(os, (char)(a.big != 0));
+        if (a.big)
+            a.big->write(os);
+        else
+            Utils::writeBinary(os, a.small);
+    }
+
+    friend bool readBinary(std::istream& is, Integer& a)
+    {
+        char isBig = 0;
+        if (!Utils::readBinary(is, isBig))
+            return false;
+        if (!isBig)
+        {
+            int64_t value;
+            if (!Utils::readBinary(is, value))
+                return false;
+            a = Integer(value);
+            return true;
+        }
+        BigInteger value;
+        if (!value.read(is))
+            return false;
+        a = Integer(value);
+        return true;
+    }
+
+    friend void writeBinary(std::ostream& os, const Integer* values, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            writeBinary(os, values[i]);
+    }
+
+    friend bool readBinary(std::istream& is, Integer* values, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            if (!readBinary(is, values[i]))
+                return false;
+        return true;
+    }
+
+private:
+
+    int64_t small;
+    BigInteger* big; // value if it doesn't fit into small, otherwise null
+
+    explicit Integer(const BigInteger& value): small(0), big(0)
+    {
+        if (value.fitsInt64())
+            small = value.toInt64();
+        else
+            big = new BigInteger(value);
+    }
+
+#ifdef __SIZEOF_INT128__
+    explicit Integer(__int128 value): small(0), big(0)
+    {
+        if ((value >= INT64_MIN) && (value <= INT64_MAX))
+            small = (int64_t)value;
+        else
+            big = new BigInteger(value);
+    }
+#endif
+
+    BigInteger toBig() const
+    { return big ? *big : BigInteger(small); }
+
+    static bool addOverflow(int64_t a, int64_t b, int64_t& result)
+    {
+#ifdef __GNUC__
+        return __builtin_add_overflow(a, b, &result);
+#else
+        if (((b > 0) && (a > INT64_MAX - b)) || ((b < 0) && (a < INT64_MIN - b)))
+            return true;
+        result = a + b;
+        return false;
+#endif
+    }
+
+    static bool subtractOverflow(int64_t a, int64_t b, int64_t& result)
+    {
+#ifdef __GNUC__
+        return __builtin_sub_overflow(a, b, &result);
+#else
+        if (((b < 0) && (a > INT64_MAX + b)) || ((b > 0) && (a < INT64_MIN + b)))
+            return true;
+        result = a - b;
+        return false;
+#endif
+    }
+
+    static bool multiplyOverflow(int64_t a, int64_t b, int64_t& result)
+    {
+#ifdef __GNUC__
+        return __builtin_mul_overflow(a, b, &result);
+#else
+        if (a && b && ((a == -1 && b == INT64_MIN) || (b == -1 && a == INT64_MIN) ||
+            ((a * b) / b != a)))
+            return true;
+        result = a * b;
+        return false;
+#endif
+    }
+};
+
+
+/* a * b - c * d, overloaded for types that can do it better. */
+template <typename T>
+inline T mulSub(const T& a, const T& b, const T& c, const T& d)
+{
+    return a * b - c * d;
+}
+
+
+template <>
+inline DotProductKernel<Integer>::Function DotProductKernel<Integer>::select()
+{
+    return &Integer::dotProduct;
+}
+
+
+/* Euclid's algorithm on int64 while possible. */
+template <>
+inline Integer gcd<Integer>(Integer a, Integer b)
+{
+    a = abs(a);
+    b = abs(b);
+    if (!a && !b)
+        return 1;
+    while (!!b)
+    {
+        Integer r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+
+} // namespace Utils
+
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef UTILS_MAPPED_ARRAY_HPP
+#define UTILS_MAPPED_ARRAY_HPP
+
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef USE_MMAP
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+namespace Utils
+{
+
+
+/* Growable array kept in memory or, after spill(), in a memory-mapped
+temporary file, so that the operating system can page it out instead of
+running out of memory. Elements move when the array grows, in a file they are
+moved bitwise, so T must not point into itself. */
+template <typename T>
+class MappedArray
+{
+public:
+
+    MappedArray(): elements(0), numElements(0), capacity(0), file(-1) {}
+
+    ~MappedArray()
+    {
+        if (isSpilled())
+        {
+            resize(0);
+            unmap();
+#ifdef USE_MMAP
+            close(file);
+#endif
+        }
+    }
+
+    /* Move storage to an unnamed file in given directory, must be called
+    while array is empty. Return if succeeded, needs build with USE_MMAP. */
+    bool spill(const std::string& directory)
+    {
+#ifdef USE_MMAP
+        if (isSpilled() || numElements)
+            return false;
+        std::string name = directory + "/qskeletonXXXXXX";
+        file = mkstemp(&name[0]);
+        if (file < 0)
+            return false;
+        // file is removed at once and lives while it is open
+        unlink(name.c_str());
+        memory.clear();
+        elements = 0;
+        capacity = 0;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool isSpilled() const { return file >= 0; }
+
+    size_t size() const { return numElements; }
+
+    T& operator [](size_t idx) { return elements[idx]; }
+    const T& operator [](size_t idx) const { return elements[idx]; }
+
+    T* begin() { return elements; }
+    T* end() { return elements + numElements; }
+
+    /* Change size, new elements are value-initialized. */
+    void resize(size_t n)
+    {
+        if (!isSpilled())
+        {
+            memory.resize(n);
+            elements = n ? &memory[0] : 0;
+            numElements = n;
+            return;
+        }
+        if (n > capacity)
+            reserve(std::max(n, 2 * capacity));
+        for (size_t i = numElements; i < n; ++i)
+            new (elements + i) T();
+        for (size_t i = n; i < numElements; ++i)
+            elements[i].~T();
+        numElements = n;
+    }
+
+private:
+
+    T* elements;
+    size_t numElements;
+    size_t capacity;
+    std::vector<T> memory; // storage if not spilled
+    int file; // descriptor of spill file, -1 if not spilled
+
+    /* Extend file and map it again, old mapping is dropped first so address
+    space is not needed twice. */
+    void reserve(size_t n)
+    {
+#ifdef USE_MMAP
+        unmap();
+        void* address = MAP_FAILED;
+        if (!ftruncate(file, (off_t)(n * sizeof(T))))
+            address = mmap(0, n * sizeof(T), PROT_READ | PROT_WRITE,
+                MAP_SHARED, file, 0);
+        if (address == MAP_FAILED)
+            throw std::bad_alloc();
+        elements = static_cast<T*>(address);
+        capacity = n;
+#endif
+    }
+
+    void unmap()
+    {
+#ifdef USE_MMAP
+        if (capacity)
+            munmap(elements, capacity * sizeof(T));
+        elements = 0;
+        capacity = 0;
+#endif
+    }
+
+    // copy is forbidden, no implementation:
+    MappedArray(const MappedArray&);
+    MappedArray& operator =(const MappedArray&);
+};
+
+
+} // namespace Utils
+
+
+#endif
@@ -2,125 +2,147 @@
 #define UTILS_MATRIX_HPP
 
 
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
+#include <new>
+#include <stdint.h>
+#include <vector>
 
 
 namespace Utils
 {
 
+
+/* View of a row of matrix, valid while the matrix is not resized and no rows
+are inserted. */
+template <typename T>
+class RowSpan
+{
+public:
+
+    RowSpan(T* _elements, size_t _size):
+        elements(_elements), numElements(_size) {}
+
+    T* data() const { return elements; }
+    size_t size() const { return numElements; }
+    T& operator [](size_t j) const { return elements[j]; }
+    T* begin() const { return elements; }
+    T* end() const { return elements + numElements; }
+
+private:
+
+    T* elements;
+    size_t numElements;
+};
+
+
 /* Class for matrix representation and basic operations.
 Is does not pretend to be efficient or support wide set of operations.
 There is no need for that because it is only used for data transmission and
 Gaussian elimination and is not used for computationally intensive parts of the
-double-description method. */
+double-description method.
+Rows are slots of one buffer aligned to cache lines, row i is in slot
+rowSlots[i], so swapping, inserting and erasing rows only move slot indexes.
+Erased slots are reused, when the buffer is full it grows twice and rows are
+laid out in order again. */
 template <typename T>
 class Matrix
 {
 public:
 
+    typedef T value_type;
+
     Matrix();
     Matrix(size_t nrows, size_t ncols, T fill = (T)0);
+    Matrix(const Matrix<T>& m);
+    Matrix(Matrix<T>&& m);
     ~Matrix();
 
-    size_t nrows() const { return numRows; }
+    Matrix& operator =(const Matrix<T>& m);
+    Matrix& operator =(Matrix<T>&& m);
+
+    size_t nrows() const { return rowSlots.size(); }
     size_t ncols() const { return numCols; }
 
-    T* row(size_t i) const { return rows[i]; }
+    T* row(size_t i) const { return elements + rowSlots[i] * stride; }
+    RowSpan<T> rowSpan(size_t i) const { return RowSpan<T>(row(i), numCols); }
 
     T& operator ()(size_t i, size_t j)
-    { return rows[i][j]; }
+    { return row(i)[j]; }
     const T& operator ()(size_t i, size_t j) const
-    { return rows[i][j]; }
+    { return row(i)[j]; }
 
+    // resize and fill with zeros
     void resize(size_t nrows, size_t ncols);
 
     void assign_eye(size_t n)
     {
-        dispose();
-        numRows = n;
-        numCols = n;
-        allocate();
+        resize(n, n);
         for (size_t i = 0; i < n; ++i)
-            for (size_t j = 0; j < n; ++j)
-                (*this)(i, j) = (i == j) ? (T)1 : (T)0;
+            (*this)(i, i) = (T)1;
     }
 
     void erase_row(size_t i)
     {
-        delete [] rows[i];
-        for (size_t j = i + 1; j < numRows; ++j)
-            rows[j - 1] = rows[j];
-        rows[numRows - 1] = 0;
-        --numRows;
-    }
-
-    T* take_row(size_t i)
-    {
-        T* result = rows[i];
-        for (size_t j = i + 1; j < numRows; ++j)
-            rows[j - 1] = rows[j];
-        rows[numRows - 1] = 0;
-        --numRows;
-        return result;
+        freeSlots.push_back(rowSlots[i]);
+        rowSlots.erase(rowSlots.begin() + i);
     }
 
     void insert_row(size_t i)
     {
-        T** newRows = new T*[numRows + 1];
-        for (size_t j = 0; j < i; ++j)
-            newRows[j] = rows[j];
-        newRows[i] = new T[numCols];
-        for (size_t j = 0; j < numCols; ++j)
-            newRows[i][j] = (T)0;
-        for (size_t j = i; j < numRows; ++j)
-            newRows[j + 1] = rows[j];
-        ++numRows;
-        delete [] rows;
-        rows = newRows;
+        size_t slot = newSlot();
+        std::fill(elements + slot * stride, elements + slot * stride + numCols,
+            (T)0);
+        rowSlots.insert(rowSlots.begin() + i, slot);
     }
 
     void insert_row(size_t i, const T* row)
     {
-        T** newRows = new T*[numRows + 1];
-        for (size_t j = 0; j < i; ++j)
-            newRows[j] = rows[j];
-        newRows[i] = new T[numCols];
-        for (size_t j = 0; j < numCols; ++j)
-            newRows[i][j] = row[j];
-        for (size_t j = i; j < numRows; ++j)
-            newRows[j + 1] = rows[j];
-        ++numRows;
-        delete [] rows;
-        rows = newRows;
+        // row of this matrix would be moved if the buffer grows
+        if ((row >= elements) && (row < elements + capacity * stride))
+        {
+            std::vector<T> copy(row, row + numCols);
+            insert_row(i, numCols ? &copy[0] : 0);
+            return;
+        }
+        size_t slot = newSlot();
+        std::copy(row, row + numCols, elements + slot * stride);
+        rowSlots.insert(rowSlots.begin() + i, slot);
     }
 
     void swap_cols(size_t i, size_t j)
     {
-        for (size_t k = 0; k < numRows; ++k)
-            std::swap(rows[k][i], rows[k][j]);
+        for (size_t k = 0; k < nrows(); ++k)
+            std::swap((*this)(k, i), (*this)(k, j));
     }
 
     void swap_rows(size_t i, size_t j)
     {
-        std::swap(rows[i], rows[j]);
+        std::swap(rowSlots[i], rowSlots[j]);
     }
 
     void mult_row(size_t i, const T& a)
     {
-        for (size_t j = 0; j < numCols; ++j)
-            rows[i][j] *= a;
+        RowSpan<T> r = rowSpan(i);
+        for (size_t j = 0; j < r.size(); ++j)
+            r[j] *= a;
     }
 
+    // divide element-wise, so it is exact for integers divisible by a
     void div_row(size_t i, const T& a)
     {
-        mult_row(i, (T)1 / a);
+        RowSpan<T> r = rowSpan(i);
+        for (size_t j = 0; j < r.size(); ++j)
+            r[j] /= a;
     }
 
     // row[i] += row[j] * a
     void addmult_rows(size_t i, size_t j, const T& a)
     {
-        for (size_t k = 0; k < numCols; ++k)
-            rows[i][k] += rows[j][k] * a;
+        RowSpan<T> ri = rowSpan(i), rj = rowSpan(j);
+        for (size_t k = 0; k < ri.size(); ++k)
+            ri[k] += rj[k] * a;
     }
 
     friend std::ostream& operator <<(std::ostream& os, const Matrix<T>& m)
@@ -132,35 +154,53 @@ public:
             os << "\n";
         }
         return os;
-    }    
-
-    Matrix(const Matrix<T>& m);
-    Matrix& operator =(const Matrix<T>& m);
+    }
 
 private:
 
-    void allocate();
-    void dispose();
+    static const size_t alignment = 64;
 
-    T** rows;
-    size_t numRows, numCols;
+    void* memory; // allocated block, elements are aligned inside it
+    T* elements;
+    size_t numCols;
+    size_t stride; // elements per slot
+    size_t numSlots, capacity; // used and allocated slots
+    std::vector<size_t> rowSlots;
+    std::vector<size_t> freeSlots;
 
+    void allocate(size_t nslots, size_t ncols);
+    void dispose();
+    size_t newSlot();
+    void swap(Matrix<T>& m);
 };
 
 
 template <typename T>
 Matrix<T>::Matrix():
-    numRows(0), numCols(0), rows(0)
+    memory(0), elements(0), numCols(0), stride(0), numSlots(0), capacity(0)
 {}
 
 template <typename T>
 Matrix<T>::Matrix(size_t nrows, size_t ncols, T fill):
-    numRows(nrows), numCols(ncols)
+    memory(0), elements(0), numCols(0), stride(0), numSlots(0), capacity(0)
 {
-    allocate();
+    resize(nrows, ncols);
     for (size_t i = 0; i < nrows; ++i)
-        for (size_t j = 0; j < ncols; ++j)
-            rows[i][j] = fill;
+        std::fill(row(i), row(i) + ncols, fill);
+}
+
+template <typename T>
+Matrix<T>::Matrix(const Matrix<T>& m):
+    memory(0), elements(0), numCols(0), stride(0), numSlots(0), capacity(0)
+{
+    *this = m;
+}
+
+template <typename T>
+Matrix<T>::Matrix(Matrix<T>&& m):
+    memory(0), elements(0), numCols(0), stride(0), numSlots(0), capacity(0)
+{
+    swap(m);
 }
 
 template <typename T>
@@ -169,53 +209,116 @@ Matrix<T>::~Matrix()
     dispose();
 }
 
+template <typename T>
+Matrix<T>& Matrix<T>::operator =(const Matrix<T>& m)
+{
+    if (this == &m)
+        return *this;
+    // keep buffer if it is enough, rows are copied in order
+    if ((capacity < m.nrows()) || (numCols != m.ncols()))
+        allocate(m.nrows(), m.ncols());
+    numSlots = m.nrows();
+    rowSlots.resize(numSlots);
+    freeSlots.clear();
+    for (size_t i = 0; i < numSlots; ++i)
+    {
+        rowSlots[i] = i;
+        std::copy(m.row(i), m.row(i) + numCols, row(i));
+    }
+    return *this;
+}
+
+template <typename T>
+Matrix<T>& Matrix<T>::operator =(Matrix<T>&& m)
+{
+    swap(m);
+    return *this;
+}
+
 template <typename T>
 void Matrix<T>::resize(size_t nrows, size_t ncols)
 {
-    dispose();
-    numRows = nrows;
-    numCols = ncols;
-    allocate();
+    allocate(nrows, ncols);
+    numSlots = nrows;
+    rowSlots.resize(nrows);
+    for (size_t i = 0; i < nrows; ++i)
+        rowSlots[i] = i;
 }
 
+/* Allocate buffer for given number of slots, all elements are zero, there
+are no rows. */
 template <typename T>
-void Matrix<T>::allocate()
+void Matrix<T>::allocate(size_t nslots, size_t ncols)
 {
-    rows = new T*[numRows];
-    for (size_t i = 0; i < numRows; ++i)
-        rows[i] = new T[numCols];
+    dispose();
+    numCols = ncols;
+    const size_t slotAlignment = (alignment % sizeof(T)) ? 1 :
+        alignment / sizeof(T);
+    stride = (ncols + slotAlignment - 1) / slotAlignment * slotAlignment;
+    capacity = nslots;
+    const size_t numElements = capacity * stride;
+    if (numElements)
+    {
+        memory = ::operator new(numElements * sizeof(T) + alignment);
+        elements = reinterpret_cast<T*>(
+            ((uintptr_t)memory + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        for (size_t k = 0; k < numElements; ++k)
+            new (elements + k) T();
+    }
 }
 
 template <typename T>
 void Matrix<T>::dispose()
 {
-    for (size_t i = 0; i < numRows; ++i)
-        delete [] rows[i];
-    delete [] rows;
+    for (size_t k = 0; k < capacity * stride; ++k)
+        elements[k].~T();
+    ::operator delete(memory);
+    memory = 0;
+    elements = 0;
+    numSlots = 0;
+    capacity = 0;
+    rowSlots.clear();
+    freeSlots.clear();
 }
 
+/* Return free slot, when there is none buffer grows twice and rows are
+placed to the first slots in their order. */
 template <typename T>
-Matrix<T>::Matrix(const Matrix<T>& m)
+size_t Matrix<T>::newSlot()
 {
-    numRows = m.nrows();
-    numCols = m.ncols();
-    allocate();
-    for (size_t i = 0; i < numRows; ++i)
-        for (size_t j = 0; j < numCols; ++j)
-            rows[i][j] = m.rows[i][j];
+    if (freeSlots.size())
+    {
+        size_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    if (numSlots == capacity)
+    {
+        Matrix<T> grown;
+        grown.allocate(std::max((size_t)4, 2 * capacity), numCols);
+        grown.numSlots = nrows();
+        grown.rowSlots.resize(nrows());
+        for (size_t i = 0; i < nrows(); ++i)
+        {
+            grown.rowSlots[i] = i;
+            std::copy(row(i), row(i) + numCols, grown.row(i));
+        }
+        swap(grown);
+    }
+    return numSlots++;
 }
 
 template <typename T>
-Matrix<T>& Matrix<T>::operator =(const Matrix<T>& m)
+void Matrix<T>::swap(Matrix<T>& m)
 {
-    dispose();
-    numRows = m.nrows();
-    numCols = m.ncols();
-    allocate();
-    for (size_t i = 0; i < m.nrows(); ++i)
-        for (size_t j = 0; j < m.ncols(); ++j)
-            (*this)(i, j) = m(i, j);
-    return *this;
+    std::swap(memory, m.memory);
+    std::swap(elements, m.elements);
+    std::swap(numCols, m.numCols);
+    std::swap(stride, m.stride);
+    std::swap(numSlots, m.numSlots);
+    std::swap(capacity, m.capacity);
+    rowSlots.swap(m.rowSlots);
+    freeSlots.swap(m.freeSlots);
 }
 
 
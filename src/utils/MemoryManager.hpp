@@ -5,18 +5,29 @@
 #include <iostream>
 #include <vector>
 
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
 
 namespace Utils
 {
 
 
+/* Pool of fixed-size cells. When built with OpenMP, cells can be allocated
+and returned concurrently from several threads. */
 class MemoryManager
 {
 
 public:
 
     MemoryManager( size_t size, size_t numNewCells = 100 ):
-        m_size(size), m_numNewCells(numNewCells) {}
+        m_size(size), m_numNewCells(numNewCells)
+    {
+#ifdef USE_OPENMP
+        omp_init_lock(&m_lock);
+#endif
+    }
     
     ~MemoryManager()
     {
@@ -27,9 +38,55 @@ public:
                 << m_unusedCells.size() << " bytes returned.\n";
         for( size_t i = 0; i < m_allocatedMemory.size(); ++i )
             delete [] m_allocatedMemory[ i ];
+#ifdef USE_OPENMP
+        omp_destroy_lock(&m_lock);
+#endif
     }
 
     void * newCell()
+    {
+        lock();
+        void * result = allocateCell();
+        unlock();
+        return result;
+    }
+
+    void deleteCell(void * pointer)
+    {
+        // if pointer is not null add to free cells
+        if (pointer)
+        {
+            lock();
+            m_unusedCells.push_back(pointer);
+            unlock();
+        }
+    }
+
+private:
+
+    size_t m_size;
+    const size_t m_numNewCells;
+    std::vector< void* > m_unusedCells;
+    std::vector< char* > m_allocatedMemory;
+#ifdef USE_OPENMP
+    omp_lock_t m_lock;
+#endif
+
+    void lock()
+    {
+#ifdef USE_OPENMP
+        omp_set_lock(&m_lock);
+#endif
+    }
+
+    void unlock()
+    {
+#ifdef USE_OPENMP
+        omp_unset_lock(&m_lock);
+#endif
+    }
+
+    void * allocateCell()
     {
         // if there are unused cells, get one of it, exclude it from unused and
         // return
@@ -62,21 +119,6 @@ public:
         }
     }
 
-
-    void deleteCell(void * pointer)
-    {
-        // if pointer is not null add to free cells
-        if (pointer)
-            m_unusedCells.push_back(pointer);
-    }
-
-private:
-
-    size_t m_size;
-    const size_t m_numNewCells;
-    std::vector< void* > m_unusedCells;
-    std::vector< char* > m_allocatedMemory;
-
     // copy is forbidden, no implementation:
     MemoryManager( const MemoryManager& );
     MemoryManager& operator =( const MemoryManager& );
@@ -0,0 +1,161 @@
+#ifndef UTILS_RATIONAL_HPP
+#define UTILS_RATIONAL_HPP
+
+
+#include "Integer.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+
+namespace Utils
+{
+
+
+/* Exact rational number, always reduced with positive denominator. Serves for
+reading decimal input exactly, computations run on integers after clearing
+denominators. */
+class Rational
+{
+public:
+
+    Rational(): numerator(0), denominator(1) {}
+    Rational(const Integer& n, const Integer& d = 1):
+        numerator(n), denominator(d) { reduce(); }
+    Rational(int n): numerator(n), denominator(1) {}
+
+    const Integer& num() const { return numerator; }
+    const Integer& den() const { return denominator; }
+
+    friend Rational operator +(const Rational& a, const Rational& b)
+    {
+        return Rational(a.numerator * b.denominator +
+            b.numerator * a.denominator, a.denominator * b.denominator);
+    }
+
+    friend Rational operator -(const Rational& a, const Rational& b)
+    {
+        return Rational(a.numerator * b.denominator -
+            b.numerator * a.denominator, a.denominator * b.denominator);
+    }
+
+    friend Rational operator *(const Rational& a, const Rational& b)
+    {
+        return Rational(a.numerator * b.numerator,
+            a.denominator * b.denominator);
+    }
+
+    friend Rational operator /(const Rational& a, const Rational& b)
+    {
+        return Rational(a.numerator * b.denominator,
+            a.denominator * b.numerator);
+    }
+
+    friend bool operator ==(const Rational& a, const Rational& b)
+    {
+        return (a.numerator == b.numerator) && (a.denominator == b.denominator);
+    }
+
+    friend bool operator !=(const Rational& a, const Rational& b)
+    { return !(a == b); }
+
+    friend bool operator <(const Rational& a, const Rational& b)
+    { return a.numerator * b.denominator < b.numerator * a.denominator; }
+
+    friend std::ostream& operator <<(std::ostream& os, const Rational& a)
+    {
+        os << a.numerator;
+        if (a.denominator != 1)
+            os << "/" << a.denominator;
+        return os;
+    }
+
+    /* Read integer, fraction p/q or decimal with optional exponent,
+    e.g. -12, 3/4, 0.125, 1.5e-3. */
+    friend std::istream& operator >>(std::istream& is, Rational& a)
+    {
+        std::string s;
+        if (!(is >> s) || !a.parse(s))
+            is.setstate(std::ios::failbit);
+        return is;
+    }
+
+private:
+
+    Integer numerator, denominator;
+
+    void reduce()
+    {
+        if (denominator < 0)
+        {
+            numerator = -numerator;
+            denominator = -denominator;
+        }
+        Integer delta = gcd(numerator, denominator);
+        if (delta != 1)
+        {
+            numerator /= delta;
+            denominator /= delta;
+        }
+    }
+
+    bool parse(const std::string& s)
+    {
+        size_t slash = s.find('/');
+        if (slash != std::string::npos)
+        {
+            std::istringstream n(s.substr(0, slash)), d(s.substr(slash + 1));
+            Integer p, q;
+            if (!(n >> p) || !(d >> q) || !q)
+                return false;
+            *this = Rational(p, q);
+            return true;
+        }
+
+        // split decimal into mantissa digits and exponent
+        size_t expPos = s.find_first_of("eE");
+        std::string mantissa = s.substr(0, expPos);
+        long exponent = 0;
+        if (expPos != std::string::npos)
+        {
+            std::istringstream e(s.substr(expPos + 1));
+            if (!(e >> exponent) || !e.eof())
+                return false;
+        }
+        size_t point = mantissa.find('.');
+        if (point != std::string::npos)
+        {
+            exponent -= (long)(mantissa.size() - point - 1);
+            mantissa.erase(point, 1);
+        }
+        std::istringstream m(mantissa);
+        Integer p;
+        if (!(m >> p))
+            return false;
+        Integer scale = 1;
+        for (long i = 0; i < (exponent < 0 ? -exponent : exponent); ++i)
+            scale *= 10;
+        *this = (exponent < 0) ? Rational(p, scale) : Rational(p * scale);
+        return true;
+    }
+};
+
+
+/* Multiply vector by positive least common multiple of denominators of its
+elements, so that it becomes integer with the same direction. */
+inline void clearDenominators(const Rational* vector, size_t size,
+    Integer* result)
+{
+    Integer multiple = 1;
+    for (size_t i = 0; i < size; ++i)
+        multiple = multiple / gcd(multiple, vector[i].den()) * vector[i].den();
+    for (size_t i = 0; i < size; ++i)
+        result[i] = vector[i].num() * (multiple / vector[i].den());
+}
+
+
+} // namespace Utils
+
+
+#endif
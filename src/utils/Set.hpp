@@ -1,6 +1,7 @@
 #ifndef UTILS_SET_HPP
 #define UTILS_SET_HPP
 
+#include "BitCount.hpp"
 #include "MemoryManager.hpp"
 #include "Vector.hpp"
 
@@ -8,7 +9,7 @@ namespace Utils
 {
 
 
-/* Set represented as bit field. */
+/* Set represented as bit field, maxPower is maximal number of elements. */
 template <size_t maxPower>
 class BitFieldSet
 {
@@ -39,43 +40,35 @@ public:
 
     Vector<size_t> toVector() const
     {
-        Vector<size_t> result;
-        for (size_t i = 0; i < maxPower; ++i)
-            if (cells[i / cellSizeBits] & ((size_t)1 << (i % cellSizeBits)))
-                result.push_back(i);
-        return result;
-    }
-
-    size_t size() const {
-        size_t result = 0;
+        Vector<size_t> result(size());
         for (size_t i = 0; i < numCells; ++i)
-        {
-            // reference code
-            //for( size_t bitIdx = 0; bitIdx < sizeBits; ++bitIdx )
-            //    result += ( m_mem[ memIdx ] & (1ULL << bitIdx ) ) ? 1 : 0;
-            size_t b = cells[i];
-            b = b - ((b >> 1) & 0x55555555UL);
-            b = (b & 0x33333333UL) + ((b >> 2) & 0x33333333UL);
-            b = (b + (b >> 4)) & 0x0F0F0F0FUL;
-            b = b + (b >> 8);
-            b = b + (b >> 16);
-            result += (b & 0x0000003FUL);
-        }
+            if (cells[i])
+                for (size_t j = 0; j < cellSizeBits; ++j)
+                    if (cells[i] & ((size_t)1 << j))
+                        result.push_back(i * cellSizeBits + j);
         return result;
     }
 
+    size_t size() const { return popcountWords(cells, numCells); }
+
     void add(size_t element)
     {
         cells[element / cellSizeBits] |=
             ((size_t)1 << (element % cellSizeBits));
     }
 
-    bool isSubsetOf(const BitFieldSet& s) const
+    void unite(const BitFieldSet& s)
     {
-        bool result = true;
         for (size_t i = 0; i < numCells; ++i)
-            result = result && !(cells[i] & ~s.cells[i]);
-        return result;
+            cells[i] |= s.cells[i];
+    }
+
+    bool isSubsetOf(const BitFieldSet& s) const
+    {
+        // for few cells a call of vectorized kernel is not worth it
+        if (numCells <= 2)
+            return isSubsetWordsScalar(cells, s.cells, numCells);
+        return isSubsetWords(cells, s.cells, numCells);
     }
 
     friend std::ostream& operator <<( std::ostream &os, const BitFieldSet& bf )
@@ -85,18 +78,7 @@ public:
 
     friend size_t intersectionSize(const BitFieldSet& a, const BitFieldSet& b)
     {
-        size_t size = 0;
-        for (size_t i = 0; i < BitFieldSet::numCells; ++i)
-        {
-            size_t cell = a.cells[i] & b.cells[i];
-            cell = cell - ((cell >> 1) & 0x55555555UL);
-            cell = (cell & 0x33333333UL) + ((cell >> 2) & 0x33333333UL);
-            cell = (cell + (cell >> 4)) & 0x0F0F0F0FUL;
-            cell = cell + (cell >> 8);
-            cell = cell + (cell >> 16);
-            size += (cell & 0x0000003FUL);
-        }
-        return size;
+        return andPopcountWords(a.cells, b.cells, BitFieldSet::numCells);
     }
 
 private:
@@ -171,6 +153,24 @@ public:
         ++numElements;
     }
 
+    /* Add all elements of s, merge is done in place from the end. */
+    void unite(const VectorSet<T>& s)
+    {
+        size_t resultSize = numElements + s.numElements - intersectionSize(*this, s);
+        ensureAllocation(resultSize);
+        size_t i = numElements, j = s.numElements, k = resultSize;
+        while (j > 0)
+            if ((i > 0) && (elements[i - 1] > s.elements[j - 1]))
+                elements[--k] = elements[--i];
+            else
+            {
+                if ((i > 0) && (elements[i - 1] == s.elements[j - 1]))
+                    --i;
+                elements[--k] = s.elements[--j];
+            }
+        numElements = resultSize;
+    }
+
     bool isSubsetOf(const VectorSet<T>& s) const
     {
         if (numElements > s.numElements)
@@ -6,9 +6,9 @@
 // otherwise go with rather low-precision clock(). Both are portable.
 #ifdef USE_OPENMP
 
+#include <omp.h>
 namespace Utils
 {
-#include <omp.h>
 double getTimeSec()
 {
     return omp_get_wtime();